@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "clara.hpp"
+#include "config.hpp"
+#include "csa.hpp"
+#include "generator.hpp"
+#include "query_cache.hpp"
+#include "realtime.hpp"
+#include "timetable_store.hpp"
+
+
+// The stop times of the trips with the delays of each trip applied, the same way as DelayUpdater applies them
+static void apply_delays(TimetableData& data, const std::map<TripID, std::map<int, int>>& delays) {
+    auto shift = [](const Time& time, const int& delay) {
+        return delay < 0 && static_cast<Time>(-delay) > time ? 0 :
+               static_cast<Time>(static_cast<int64_t>(time) + delay);
+    };
+
+    for (const auto& trip_delays: delays) {
+        Time previous_departure = 0;
+
+        for (auto& event: data.trip_events[trip_delays.first]) {
+            auto iter = trip_delays.second.upper_bound(event.stop_sequence);
+            int delay = iter == trip_delays.second.begin() ? 0 : std::prev(iter)->second;
+
+            event.arrival_time = std::max(shift(event.arrival_time, delay), previous_departure);
+            event.departure_time = std::max(shift(event.departure_time, delay), event.arrival_time);
+            previous_departure = event.departure_time;
+        }
+    }
+}
+
+
+// Apply random batches of delays to a store with DelayUpdater, then compare the earliest arrival and the latest
+// departure times on the published snapshot with the ones on a timetable built again from the delayed stop times.
+// Returns the number of queries whose results differ.
+static std::size_t check_delays(const TimetableData& data, std::mt19937& rng, const std::size_t& n_queries) {
+    TimetableStore store {std::make_shared<const Timetable>(data)};
+    std::map<TripID, std::map<int, int>> delays;
+
+    {
+        DelayUpdater updater {store};
+        std::vector<DelayEvent> events;
+
+        for (std::size_t i = 0; i < 2000; ++i) {
+            TripID trip_id = rng() % data.trip_events.size();
+            int stop_sequence = rng() % 10;
+            int delay = static_cast<int>(rng() % 1200) - 300;
+
+            events.emplace_back(trip_id, stop_sequence, delay);
+            delays[trip_id][stop_sequence] = delay;
+
+            if (events.size() == 1 + i % 50) {
+                updater.apply(events);
+                events.clear();
+            }
+        }
+
+        updater.apply(events);
+    }
+
+    TimetableData delayed_data {data};
+    apply_delays(delayed_data, delays);
+
+    auto delayed = store.acquire();
+    Timetable expected {delayed_data};
+    ConnectionScan csa {delayed.get()};
+    ConnectionScan expected_csa {&expected};
+    std::size_t n_differ = 0;
+
+    for (std::size_t i = 0; i < n_queries; ++i) {
+        NodeID source_id = rng() % data.n_stops;
+        NodeID target_id = rng() % data.n_stops;
+        Time time = 6 * 3600 + rng() % (16 * 3600);
+
+        csa.init();
+        expected_csa.init();
+
+        if (csa.query(source_id, target_id, time) != expected_csa.query(source_id, target_id, time)) ++n_differ;
+
+        csa.clear();
+        expected_csa.clear();
+        csa.init();
+        expected_csa.init();
+
+        if (csa.latest_departure_query(source_id, target_id, time) !=
+            expected_csa.latest_departure_query(source_id, target_id, time)) {
+            ++n_differ;
+        }
+
+        csa.clear();
+        expected_csa.clear();
+    }
+
+    std::cout << "Delays: " << n_differ << " of " << 2 * n_queries << " queries differ" << std::endl;
+
+    return n_differ;
+}
+
+
+// Replicate a store on two nodes, both on the first CPU, and check at each publication that the nodes run
+// the queries on their own copies of the snapshot, with the same generation and the same earliest arrival times.
+// Returns the number of publications and queries where this does not hold.
+static std::size_t check_replicas(const TimetableData& data, std::mt19937& rng, const std::size_t& n_queries) {
+    TimetableStore store {std::make_shared<const Timetable>(data)};
+    store.replicate({{0}, {0}});
+
+    uint64_t previous_generation = 0;
+    std::size_t n_differ = 0;
+
+    for (int publication = 0; publication < 3; ++publication) {
+        ConnectionScan first {&store, 0};
+        ConnectionScan second {&store, 1};
+
+        first.init();
+        second.init();
+
+        if (&first.timetable() == &second.timetable() || first.generation() != second.generation() ||
+            first.generation() <= previous_generation) {
+            ++n_differ;
+        }
+
+        previous_generation = first.generation();
+
+        for (std::size_t i = 0; i < n_queries; ++i) {
+            NodeID source_id = rng() % data.n_stops;
+            NodeID target_id = rng() % data.n_stops;
+            Time departure_time = 6 * 3600 + rng() % (16 * 3600);
+
+            Time arrival_time = first.query(source_id, target_id, departure_time);
+
+            if (arrival_time != second.query(source_id, target_id, departure_time)) ++n_differ;
+
+            first.clear();
+            second.clear();
+            first.init();
+            second.init();
+        }
+
+        first.clear();
+        second.clear();
+
+        store.publish(store.acquire());
+    }
+
+    std::cout << "Replicas: " << n_differ << " of " << 3 * (n_queries + 1) << " publications and queries differ"
+              << std::endl;
+
+    return n_differ;
+}
+
+
+// Answer earliest arrival queries between a few stop pairs from the cached profiles, with and without the hub
+// labels, and compare them with the uncached queries. Returns the number of queries whose results differ.
+static std::size_t check_profile_cache(const TimetableData& data, std::mt19937& rng, const std::size_t& n_queries) {
+    std::size_t n_differ = 0;
+
+    for (const bool& hl: {false, true}) {
+        use_hl = hl;
+
+        Timetable timetable {data};
+        ConnectionScan csa {&timetable};
+        QueryCache cache {n_queries, 1, true};
+
+        // The pairs are repeated, so that most of the queries are answered from the cache
+        std::vector<std::pair<NodeID, NodeID>> pairs;
+
+        for (std::size_t i = 0; i < 20; ++i) {
+            pairs.emplace_back(rng() % data.n_stops, rng() % data.n_stops);
+        }
+
+        for (std::size_t i = 0; i < n_queries; ++i) {
+            const auto& pair = pairs[rng() % pairs.size()];
+            Time departure_time = 6 * 3600 + rng() % (16 * 3600);
+
+            csa.init();
+            Time arrival_time = cache.query(csa, pair.first, pair.second, departure_time);
+            csa.clear();
+            csa.init();
+
+            if (arrival_time != csa.query(pair.first, pair.second, departure_time)) ++n_differ;
+
+            csa.clear();
+        }
+    }
+
+    use_hl = false;
+
+    std::cout << "Profile cache: " << n_differ << " of " << 2 * n_queries << " queries differ" << std::endl;
+
+    return n_differ;
+}
+
+
+// Compare the earliest arrival queries between sets of stops with offsets, with and without the hub labels, with
+// the minimum over the pairs of a source and a target of the point queries departing after the offset of the source,
+// plus the offset of the target. Returns the number of queries whose results differ.
+static std::size_t check_set_queries(const TimetableData& data, std::mt19937& rng, const std::size_t& n_queries) {
+    std::size_t n_differ = 0;
+
+    for (const bool& hl: {false, true}) {
+        use_hl = hl;
+
+        Timetable timetable {data};
+        ConnectionScan csa {&timetable};
+
+        for (std::size_t i = 0; i < n_queries; ++i) {
+            std::vector<StopOffset> sources;
+            std::vector<StopOffset> targets;
+
+            for (std::size_t k = 0; k < 3; ++k) {
+                sources.push_back({static_cast<NodeID>(rng() % data.n_stops), static_cast<Time>(rng() % 600)});
+                targets.push_back({static_cast<NodeID>(rng() % data.n_stops), static_cast<Time>(rng() % 600)});
+            }
+
+            Time departure_time = 6 * 3600 + rng() % (16 * 3600);
+            Time expected_time = INF + 600;
+
+            for (const auto& source: sources) {
+                for (const auto& target: targets) {
+                    csa.init();
+                    expected_time = std::min(expected_time, csa.query(source.stop_id, target.stop_id,
+                                                                      departure_time + source.time) + target.time);
+                    csa.clear();
+                }
+            }
+
+            csa.init();
+
+            if (csa.query(sources, targets, departure_time) != expected_time) ++n_differ;
+
+            csa.clear();
+        }
+    }
+
+    use_hl = false;
+
+    std::cout << "Set queries: " << n_differ << " of " << 2 * n_queries << " queries differ" << std::endl;
+
+    return n_differ;
+}
+
+
+// Check that the earliest arrival query departing at the latest departure time found for an arrival time arrives
+// in time, and that the one departing a second later does not, with and without the hub labels. Returns the
+// number of queries where this does not hold.
+static std::size_t check_latest_departures(const TimetableData& data, std::mt19937& rng,
+                                           const std::size_t& n_queries) {
+    std::size_t n_differ = 0;
+    std::size_t n_reached = 0;
+
+    for (const bool& hl: {false, true}) {
+        use_hl = hl;
+
+        Timetable timetable {data};
+        ConnectionScan csa {&timetable};
+
+        for (std::size_t i = 0; i < n_queries; ++i) {
+            NodeID source_id = rng() % data.n_stops;
+            NodeID target_id = rng() % data.n_stops;
+            Time arrival_time = 8 * 3600 + rng() % (16 * 3600);
+
+            csa.init();
+            Time departure_time = csa.latest_departure_query(source_id, target_id, arrival_time);
+            csa.clear();
+
+            // The target cannot be reached in time
+            if (departure_time == 0) continue;
+
+            ++n_reached;
+
+            csa.init();
+            bool in_time = csa.query(source_id, target_id, departure_time) <= arrival_time;
+            csa.clear();
+            csa.init();
+            bool later_in_time = csa.query(source_id, target_id, departure_time + 1) <= arrival_time;
+            csa.clear();
+
+            if (!in_time || later_in_time) ++n_differ;
+        }
+    }
+
+    use_hl = false;
+
+    std::cout << "Latest departures: " << n_differ << " of " << n_reached
+              << " queries reaching the target in time differ" << std::endl;
+
+    return n_differ;
+}
+
+
+// Compare the profiles of the sources read from a single backward scan to their target with the ones of the profile
+// queries, with and without the hub labels. Returns the number of queries whose profiles differ.
+static std::size_t check_all_to_one(const TimetableData& data, std::mt19937& rng, const std::size_t& n_queries) {
+    std::size_t n_differ = 0;
+
+    auto same_pairs = [](const ProfilePareto& profile1, const ProfilePareto& profile2) {
+        return profile1.size() == profile2.size() &&
+               std::equal(profile1.begin(), profile1.end(), profile2.begin(), [](const Pair& pair1, const Pair& pair2) {
+                   return pair1.dep == pair2.dep && pair1.arr == pair2.arr;
+               });
+    };
+
+    for (const bool& hl: {false, true}) {
+        use_hl = hl;
+
+        Timetable timetable {data};
+        ConnectionScan csa {&timetable};
+
+        // The queries are grouped by target, as with --all-to-one
+        for (std::size_t i = 0; i < n_queries; i += 10) {
+            NodeID target_id = rng() % data.n_stops;
+            std::vector<ProfilePareto> profiles;
+            std::vector<NodeID> source_ids;
+
+            csa.init();
+            csa.all_to_one_profile(target_id);
+
+            for (std::size_t k = 0; k < 10; ++k) {
+                source_ids.push_back(rng() % data.n_stops);
+                profiles.push_back(csa.source_profile(source_ids.back()));
+            }
+
+            csa.clear();
+
+            for (std::size_t k = 0; k < source_ids.size(); ++k) {
+                csa.init();
+
+                if (!same_pairs(profiles[k], csa.profile_query(source_ids[k], target_id))) ++n_differ;
+
+                csa.clear();
+            }
+        }
+    }
+
+    use_hl = false;
+
+    std::cout << "All-to-one profiles: " << n_differ << " of " << 2 * n_queries << " queries differ" << std::endl;
+
+    return n_differ;
+}
+
+
+int main(int argc, char* argv[]) {
+    bool show_help;
+    GeneratorParams params;
+    params.kind = NetworkKind::Country;
+    params.n_stops = 500;
+    params.min_headway = 600;
+    params.max_headway = 1800;
+    std::size_t n_queries = 500;
+
+    auto cli_parser = clara::Opt(params.n_stops, "stops")["-s"]["--stops"]
+                              ("The number of stops of the generated country network, 500 by default") |
+                      clara::Opt(n_queries, "queries")["-q"]["--queries"]
+                              ("The number of random queries of each check, 500 by default") |
+                      clara::Opt(params.seed, "seed")["--seed"]("The seed of the random generator") |
+                      clara::Help(show_help);
+
+    auto result = cli_parser.parse(clara::Args(argc, argv));
+    if (!result) {
+        std::cerr << "Error in command line: " << result.errorMessage() << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (show_help) {
+        cli_parser.writeToStream(std::cout);
+        return 0;
+    }
+
+    TimetableData data = TimetableGenerator {params}.generate();
+    std::mt19937 rng {params.seed};
+    std::size_t n_differ = 0;
+
+    n_differ += check_delays(data, rng, n_queries);
+    n_differ += check_replicas(data, rng, n_queries);
+    n_differ += check_profile_cache(data, rng, n_queries);
+    n_differ += check_set_queries(data, rng, n_queries);
+    n_differ += check_latest_departures(data, rng, n_queries);
+    n_differ += check_all_to_one(data, rng, n_queries);
+
+    if (n_differ > 0) {
+        std::cerr << "Error occurred while checking the algorithms, " << n_differ << " results differ" << std::endl;
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include "config.hpp"
+
+std::string name;
+bool use_hl;
+bool profile;
+bool latest;
+std::size_t board;
+bool ranked;
+bool renumber;
+bool prune;
+std::size_t reload_interval;
+std::string snapshot_path;
+bool use_huge_pages;
+std::size_t n_threads;
+std::string schedule;
+std::size_t cache_size;
+std::size_t cache_bucket = 1;
+bool profile_cache;
+bool all_to_one;
+std::size_t nearby;
+std::string algorithm = "csa";
+std::size_t cells = 32;
+std::size_t lower_bound_targets;
+std::string kernel = "scalar";
+std::size_t prefetch_distance = 16;
+bool prefetch_sweep;
+bool narrow;
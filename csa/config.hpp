@@ -6,6 +6,27 @@
 extern std::string name;
 extern bool use_hl;
 extern bool profile;
+extern bool latest;
+extern std::size_t board;
 extern bool ranked;
+extern bool renumber;
+extern bool prune;
+extern std::size_t reload_interval;
+extern std::string snapshot_path;
+extern bool use_huge_pages;
+extern std::size_t n_threads;
+extern std::string schedule;
+extern std::size_t cache_size;
+extern std::size_t cache_bucket;
+extern bool profile_cache;
+extern bool all_to_one;
+extern std::size_t nearby;
+extern std::string algorithm;
+extern std::size_t cells;
+extern std::size_t lower_bound_targets;
+extern std::string kernel;
+extern std::size_t prefetch_distance;
+extern bool prefetch_sweep;
+extern bool narrow;
 
 #endif // CONFIG_HPP
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "connection_profiles.hpp"
+
+
+ConnectionProfiles::ConnectionProfiles(const Timetable* timetable_p) : _timetable {timetable_p}, _target_id {0} {
+    walking_time_to_target.assign(_timetable->max_node_id + 1, INF);
+    trip_time.resize(_timetable->max_trip_id + 1);
+    conn_time.resize(_timetable->connections.size());
+}
+
+
+void ConnectionProfiles::scan(const NodeID& target_id) {
+    const auto& connections = _timetable->connections;
+
+    for (const auto& transfer: _timetable->backward_transfers(_target_id)) {
+        walking_time_to_target[transfer.source_id] = INF;
+    }
+
+    _target_id = target_id;
+
+    for (const auto& transfer: _timetable->backward_transfers(target_id)) {
+        walking_time_to_target[transfer.source_id] = transfer.time;
+    }
+
+    stop_profile.assign(_timetable->max_node_id + 1, BasicProfilePareto<ConnectionPair> {});
+    std::fill(trip_time.begin(), trip_time.end(), INF);
+
+    for (std::size_t k = connections.size(); k-- > 0;) {
+        const auto& conn = connections[k];
+        const auto& walking_time = walking_time_to_target[conn.arrival_stop_id];
+
+        Time t1 = walking_time == INF ? INF : conn.arrival_time + walking_time;
+        Time t2 = trip_time[conn.trip_id];
+        Time t3 = stop_profile[conn.arrival_stop_id].arrival_time(conn.arrival_time);
+        Time t_conn = std::min({t1, t2, t3});
+
+        conn_time[k] = t_conn;
+        trip_time[conn.trip_id] = t_conn;
+
+        ConnectionPair conn_pair {conn.departure_time, t_conn, static_cast<ConnectionID>(k)};
+
+        if (t_conn == INF || stop_profile[conn.departure_stop_id].dominates(conn_pair)) continue;
+
+        stop_profile[conn.departure_stop_id].emplace(conn_pair, false);
+
+        for (const auto& transfer: _timetable->backward_transfers(conn.departure_stop_id)) {
+            stop_profile[transfer.source_id].emplace({conn.departure_time - transfer.time, t_conn,
+                                                      static_cast<ConnectionID>(k)});
+        }
+    }
+}
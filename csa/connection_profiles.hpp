@@ -0,0 +1,88 @@
+#ifndef CONNECTION_PROFILES_HPP
+#define CONNECTION_PROFILES_HPP
+
+#include <vector>
+
+#include "data_structure.hpp"
+#include "profile_pareto.hpp"
+
+
+// A pair of a profile with the connection starting its journey, boarded at the stop of the profile
+// or after walking from it
+struct ConnectionPair : public Pair {
+    ConnectionID conn_id;
+
+    ConnectionPair() : Pair {}, conn_id {0} {};
+
+    ConnectionPair(Time d, Time a, ConnectionID c = 0) : Pair {d, a}, conn_id {c} {};
+};
+
+
+// The profiles of all the stops to a target computed by the backward scan of ConnectionScan::all_to_one_profile
+// without hub labels, where each pair records the first connection of its journey. The journeys of the pairs
+// can then be unpacked, which is the base of the preprocessing of the speedup techniques.
+class ConnectionProfiles {
+private:
+    const Timetable* _timetable;
+    NodeID _target_id;
+
+    std::vector<BasicProfilePareto<ConnectionPair>> stop_profile;
+    std::vector<Time> walking_time_to_target;
+    std::vector<Time> trip_time;
+
+    // The arrival time at the target when starting with each connection
+    std::vector<Time> conn_time;
+
+public:
+    explicit ConnectionProfiles(const Timetable* timetable_p);
+
+    void scan(const NodeID& target_id);
+
+    const BasicProfilePareto<ConnectionPair>& profile(const NodeID& stop_id) const { return stop_profile[stop_id]; }
+
+    const Time& walking_time(const NodeID& stop_id) const { return walking_time_to_target[stop_id]; }
+
+    // Unpack the journey starting with the given connection. The function is called for each trip of the journey
+    // with the walking time before boarding it and its first and last connections, and the unpacking stops
+    // if it returns false. The journey ends by walking from the arrival stop of the last trip to the target.
+    // Returns whether the journey was unpacked up to the target.
+    template<class LegFunction>
+    bool unpack(ConnectionID conn_id, Time walking_time, LegFunction leg) const;
+};
+
+
+template<class LegFunction>
+bool ConnectionProfiles::unpack(ConnectionID conn_id, Time walking_time, LegFunction leg) const {
+    const auto& connections = _timetable->connections;
+
+    while (true) {
+        // Stay on the trip as long as the arrival time at the target stays the same
+        const auto& first_conn = connections[conn_id];
+        ConnectionID last_id = conn_id;
+
+        for (const auto& id: _timetable->trip_connections(first_conn.trip_id, first_conn.stop_sequence)) {
+            if (id != conn_id && conn_time[id] != conn_time[last_id]) break;
+
+            last_id = id;
+        }
+
+        if (!leg(walking_time, conn_id, last_id)) return false;
+
+        const auto& last_conn = connections[last_id];
+        const auto& final_walking_time = walking_time_to_target[last_conn.arrival_stop_id];
+
+        if (final_walking_time != INF && last_conn.arrival_time + final_walking_time == conn_time[last_id]) {
+            return true;
+        }
+
+        // Otherwise the pair of the arrival stop giving the arrival time continues the journey
+        const auto& next_pair = stop_profile[last_conn.arrival_stop_id].best_pair(last_conn.arrival_time);
+
+        if (next_pair.dep == INF || next_pair.arr != conn_time[last_id]) return false;
+
+        conn_id = next_pair.conn_id;
+        walking_time = connections[conn_id].departure_time - next_pair.dep;
+    }
+}
+
+#endif // CONNECTION_PROFILES_HPP
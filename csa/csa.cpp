@@ -5,33 +5,77 @@
 #include "csa.hpp"
 
 
-Time ConnectionScan::query(const NodeID& source_id, const NodeID& target_id,
+Time ConnectionScan::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time,
+                           const bool& target_pruning, const std::vector<Time>* lower_bounds) {
+    StopOffset source {source_id, 0};
+    StopOffset target {target_id, 0};
+
+    return scan(trip_reached, {&source, &source + 1}, {&target, &target + 1}, departure_time, target_pruning,
+                lower_bounds != nullptr ? lower_bounds->data() : nullptr);
+}
+
+
+Time ConnectionScan::query(const std::vector<StopOffset>& sources, const std::vector<StopOffset>& targets,
                            const Time& departure_time, const bool& target_pruning) {
+    return scan(trip_reached, {sources.data(), sources.data() + sources.size()},
+                {targets.data(), targets.data() + targets.size()}, departure_time, target_pruning);
+}
+
+
+// The earliest arrival time at the point behind the targets
+Time ConnectionScan::arrival_time_at_targets(const ArrayView<StopOffset>& targets) const {
+    Time arrival_time {INF};
+
+    for (const auto& target: targets) {
+        arrival_time = std::min(arrival_time, earliest_arrival_time[target.stop_id] + target.time);
+    }
+
+    return arrival_time;
+}
+
+
+// The forward scan of the connections, the state of the trips is stored in packed bits
+// for the earliest arrival query, and in the trip records for the profile query
+template<class TripState>
+Time ConnectionScan::scan(TripState& trip_state, const ArrayView<StopOffset>& sources,
+                          const ArrayView<StopOffset>& targets, const Time& departure_time,
+                          const bool& target_pruning, const Time* lower_bounds) {
     Time tmp_time;
 
     #ifdef PROFILE
     Profiler prof {__func__};
     #endif
 
-    // Walk from the source to all of its neighbours
+    // Walk from the sources to all of their neighbours, starting from each source at its offset
     if (!use_hl) {
-        for (const auto& transfer: _timetable->stops[source_id].transfers) {
-            earliest_arrival_time[transfer.target_id] = departure_time + transfer.time;
+        for (const auto& source: sources) {
+            for (const auto& transfer: _timetable->transfers(source.stop_id)) {
+                tmp_time = departure_time + source.time + transfer.time;
+
+                if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+                    earliest_arrival_time[transfer.target_id] = tmp_time;
+                }
+            }
         }
     } else {
-        // Propagate the departure time from the source stop to all its out-hubs
-        for (const auto& hub_link: _timetable->stops[source_id].out_hubs) {
-            const auto& walking_time = hub_link.time;
-            const auto& hub_id = hub_link.hub_id;
+        // Propagate the departure times from the source stops to all their out-hubs
+        for (const auto& source: sources) {
+            for (const auto& hub_link: _timetable->out_hubs(source.stop_id)) {
+                const auto& walking_time = hub_link.time;
+                const auto& hub_id = hub_link.hub_id;
 
-            tmp_time = departure_time + walking_time;
-            earliest_arrival_time[hub_id] = tmp_time;
+                tmp_time = departure_time + source.time + walking_time;
+
+                if (tmp_time < earliest_arrival_time[hub_id]) {
+                    earliest_arrival_time[hub_id] = tmp_time;
+                }
+            }
         }
 
         for (const auto& stop: _timetable->stops) {
             const auto& stop_id = stop.id;
 
-            for (const auto& hub_link: stop.in_hubs) {
+            for (const auto& hub_link: _timetable->in_hubs(stop_id)) {
                 const auto& walking_time = hub_link.time;
                 const auto& hub_id = hub_link.hub_id;
 
@@ -54,6 +98,9 @@ Time ConnectionScan::query(const NodeID& source_id, const NodeID& target_id,
     const auto& first_conn_iter = std::lower_bound(_timetable->connections.begin(), _timetable->connections.end(),
                                                    dummy_conn);
 
+    // The arrival time at the targets is only recomputed when the arrival time at a stop improves
+    Time target_time = arrival_time_at_targets(targets);
+
     for (auto iter = first_conn_iter; iter != _timetable->connections.end(); ++iter) {
         #ifdef PROFILE
         Profiler loop {"Loop"};
@@ -63,56 +110,85 @@ Time ConnectionScan::query(const NodeID& source_id, const NodeID& target_id,
         const auto& arr_id = conn.arrival_stop_id;
         const auto& dep_id = conn.departure_stop_id;
 
-        if (target_pruning && earliest_arrival_time[target_id] <= conn.departure_time) {
-            // We need to check if earliest_arrival_time[target_id] can still be improved
-            // before break out of the loop
-            if (use_hl) {
-                update_using_in_hubs(target_id);
-            }
-
+        if (target_pruning && target_time <= conn.departure_time) {
             break;
         }
 
-        if (!is_reached[conn.trip_id] && use_hl) {
+        if (use_hl && !trip_state.is_reached(conn.trip_id)) {
+            // The in-hubs are not walked if the target cannot be reached earlier from the departure
+            // of the connection, nor from the later connections of its trip, which are skipped the same way
+            if (lower_bounds != nullptr && conn.departure_time + lower_bounds[dep_id] >= target_time) {
+                continue;
+            }
+
             update_using_in_hubs(dep_id);
+            target_time = arrival_time_at_targets(targets);
         }
 
         // Check if the trip containing the connection has been reached,
         // or we can get to the connection's departure stop before its departure
-        if (is_reached[conn.trip_id] || earliest_arrival_time[dep_id] <= conn.departure_time) {
+        if (trip_state.is_reached(conn.trip_id) || earliest_arrival_time[dep_id] <= conn.departure_time) {
             // Mark the trip containing the connection as reached
-            is_reached[conn.trip_id] = true;
+            trip_state.mark_reached(conn.trip_id);
 
-            // Check if the arrival time to the arrival stop of the connection can be improved
-            if (conn.arrival_time < earliest_arrival_time[arr_id]) {
+            // Check if the arrival time to the arrival stop of the connection can be improved,
+            // and if the target can still be reached earlier from there
+            if (conn.arrival_time < earliest_arrival_time[arr_id] &&
+                (lower_bounds == nullptr || conn.arrival_time + lower_bounds[arr_id] < target_time)) {
                 earliest_arrival_time[arr_id] = conn.arrival_time;
 
-                update_out_hubs(arr_id, conn.arrival_time, target_id);
+                // Without target pruning, the walks arriving after the target are still needed
+                // to reach the later trips
+                update_out_hubs(arr_id, conn.arrival_time, target_pruning ? target_time : INF);
+                target_time = arrival_time_at_targets(targets);
             }
         }
     }
 
-    return earliest_arrival_time[target_id];
+    // The earliest arrival times of the targets can still be improved by walking from their in-hubs,
+    // also when the scan reached the last connection
+    if (use_hl) {
+        for (const auto& target: targets) {
+            update_using_in_hubs(target.stop_id);
+        }
+    }
+
+    return arrival_time_at_targets(targets);
 }
 
 
 void ConnectionScan::init() {
+    if (_store != nullptr) {
+        _snapshot = _store->acquire(_node, _generation);
+        _timetable = _snapshot.get();
+    }
+
     earliest_arrival_time.assign(_timetable->max_node_id + 1, INF);
-    is_reached.resize(_timetable->max_trip_id + 1);
+    latest_departure_time.assign(_timetable->max_node_id + 1, 0);
+
+    // The trip states are invalidated by starting a new epoch, they keep their memory between queries
+    trip_reached.resize(_timetable->max_trip_id + 1);
+    trip_reached.reset();
+    trip_records.resize(_timetable->max_trip_id + 1);
+    trip_records.reset();
 
     stop_profile.resize(_timetable->max_node_id + 1);
-    trip_earliest_time.assign(_timetable->max_trip_id + 1, INF);
     walking_time_to_target.assign(_timetable->max_node_id + 1, INF);
 }
 
 
 void ConnectionScan::clear() {
     earliest_arrival_time.clear();
-    is_reached.clear();
+    latest_departure_time.clear();
 
     stop_profile.clear();
-    trip_earliest_time.clear();
     walking_time_to_target.clear();
+
+    // Release the snapshot as soon as the query completes, so that an outdated one can be freed
+    if (_store != nullptr) {
+        _snapshot.reset();
+        _timetable = nullptr;
+    }
 }
 
 
@@ -126,7 +202,7 @@ void ConnectionScan::update_using_in_hubs(const NodeID& dep_id) {
 
     Time tmp_time;
 
-    for (const auto& hub_link: _timetable->stops[dep_id].in_hubs) {
+    for (const auto& hub_link: _timetable->in_hubs(dep_id)) {
         const auto& walking_time = hub_link.time;
         const auto& hub_id = hub_link.hub_id;
 
@@ -142,26 +218,25 @@ void ConnectionScan::update_using_in_hubs(const NodeID& dep_id) {
 }
 
 
+// The walks arriving after the given target time cannot improve the arrival time at the targets
 void ConnectionScan::update_out_hubs(const NodeID& arr_id, const Time& arrival_time,
-                                     const NodeID& target_id) {
+                                     const Time& target_time) {
     #ifdef PROFILE
     Profiler prof {__func__};
     #endif
 
-    const Stop& arrival_stop = _timetable->stops[arr_id];
-
     Time tmp_time;
 
     if (!use_hl) {
         // Update the earliest arrival time of the out-neighbours of the arrival stop
-        for (const auto& transfer: arrival_stop.transfers) {
+        for (const auto& transfer: _timetable->transfers(arr_id)) {
             // Compute the arrival time at the destination of the transfer
             tmp_time = arrival_time + transfer.time;
 
             // Since the transfers are sorted in the increasing order of walking time,
             // we can skip the scanning of the transfers as soon as the arrival time
             // of the destination is later than that of the target stop
-            if (tmp_time > earliest_arrival_time[target_id]) break;
+            if (tmp_time > target_time) break;
 
             if (tmp_time < earliest_arrival_time[transfer.target_id]) {
                 earliest_arrival_time[transfer.target_id] = tmp_time;
@@ -169,13 +244,13 @@ void ConnectionScan::update_out_hubs(const NodeID& arr_id, const Time& arrival_t
         }
     } else {
         // Update the earliest arrival time of the out-hubs of the arrival stop
-        for (const auto& hub_link: arrival_stop.out_hubs) {
+        for (const auto& hub_link: _timetable->out_hubs(arr_id)) {
             const auto& walking_time = hub_link.time;
             const auto& hub_id = hub_link.hub_id;
 
             tmp_time = arrival_time + walking_time;
 
-            if (tmp_time > earliest_arrival_time[target_id]) break;
+            if (tmp_time > target_time) break;
 
             if (tmp_time < earliest_arrival_time[hub_id]) {
                 earliest_arrival_time[hub_id] = tmp_time;
@@ -185,18 +260,177 @@ void ConnectionScan::update_out_hubs(const NodeID& arr_id, const Time& arrival_t
 }
 
 
+// The reverse of the earliest arrival query: the connections are scanned in the decreasing order
+// of their arrival times, a trip is reached from its later connections, and the footpaths are
+// walked backward from the target. The latest departure time of a node is 0 while the target
+// cannot be reached from it in time.
+Time ConnectionScan::latest_departure_query(const NodeID& source_id, const NodeID& target_id,
+                                            const Time& arrival_time, const bool& source_pruning) {
+    // Walk to the target from all of its neighbours
+    if (!use_hl) {
+        for (const auto& transfer: _timetable->backward_transfers(target_id)) {
+            if (transfer.time < arrival_time) {
+                latest_departure_time[transfer.source_id] = std::max(latest_departure_time[transfer.source_id],
+                                                                     arrival_time - transfer.time);
+            }
+        }
+    } else {
+        for (const auto& hub_link: _timetable->in_hubs(target_id)) {
+            if (hub_link.time < arrival_time) {
+                latest_departure_time[hub_link.hub_id] = std::max(latest_departure_time[hub_link.hub_id],
+                                                                  arrival_time - hub_link.time);
+            }
+        }
+
+        for (const auto& stop: _timetable->stops) {
+            update_using_out_hubs(stop.id);
+        }
+    }
+
+    // The connections arriving not after arrival_time are before this position in the arrival order
+    const auto& connections = _timetable->connections;
+    const auto& order = _timetable->arrival_order;
+    const auto& last = std::upper_bound(order.begin(), order.end(), arrival_time,
+                                        [&](const Time& time, const ConnectionID& i) {
+                                            return time < connections[i].arrival_time;
+                                        });
+
+    for (auto iter = std::reverse_iterator<const ConnectionID*>(last); iter != order.rend(); ++iter) {
+        const Connection& conn = connections[*iter];
+        const auto& arr_id = conn.arrival_stop_id;
+        const auto& dep_id = conn.departure_stop_id;
+
+        // No journey using this connection or the next ones can leave the source later
+        if (source_pruning && latest_departure_time[source_id] >= conn.arrival_time) {
+            break;
+        }
+
+        if (use_hl && !trip_reached.is_reached(conn.trip_id)) {
+            update_using_out_hubs(arr_id);
+        }
+
+        // Check if the trip containing the connection has been reached,
+        // or we can reach the target from the connection's arrival stop after its arrival
+        if (trip_reached.is_reached(conn.trip_id) || latest_departure_time[arr_id] >= conn.arrival_time) {
+            trip_reached.mark_reached(conn.trip_id);
+
+            if (conn.departure_time > latest_departure_time[dep_id]) {
+                latest_departure_time[dep_id] = conn.departure_time;
+
+                update_in_hubs(dep_id, conn.departure_time, latest_departure_time[source_id]);
+            }
+        }
+    }
+
+    if (use_hl) {
+        update_using_out_hubs(source_id);
+    }
+
+    return latest_departure_time[source_id];
+}
+
+
+// Update the latest departure time of a stop by walking to its out-hubs
+void ConnectionScan::update_using_out_hubs(const NodeID& stop_id) {
+    for (const auto& hub_link: _timetable->out_hubs(stop_id)) {
+        const auto& hub_time = latest_departure_time[hub_link.hub_id];
+
+        if (hub_time > hub_link.time && hub_time - hub_link.time > latest_departure_time[stop_id]) {
+            latest_departure_time[stop_id] = hub_time - hub_link.time;
+        }
+    }
+}
+
+
+// Update the latest departure times of the nodes walking to the departure stop of a connection,
+// the walks leaving before the given source time cannot improve the departure time from the source
+void ConnectionScan::update_in_hubs(const NodeID& dep_id, const Time& departure_time, const Time& source_time) {
+    if (!use_hl) {
+        // The backward transfers are sorted in the increasing order of walking time
+        for (const auto& transfer: _timetable->backward_transfers(dep_id)) {
+            if (transfer.time >= departure_time) break;
+
+            Time tmp_time = departure_time - transfer.time;
+
+            if (tmp_time < source_time) break;
+
+            if (tmp_time > latest_departure_time[transfer.source_id]) {
+                latest_departure_time[transfer.source_id] = tmp_time;
+            }
+        }
+    } else {
+        for (const auto& hub_link: _timetable->in_hubs(dep_id)) {
+            if (hub_link.time >= departure_time) break;
+
+            Time tmp_time = departure_time - hub_link.time;
+
+            if (tmp_time < source_time) break;
+
+            if (tmp_time > latest_departure_time[hub_link.hub_id]) {
+                latest_departure_time[hub_link.hub_id] = tmp_time;
+            }
+        }
+    }
+}
+
+
 ProfilePareto ConnectionScan::profile_query(const NodeID& source_id,
                                             const NodeID& target_id) {
-    // Run a normal query with departure_time 0 and do not target-prune to scan all connections
-    query(source_id, target_id, 0, false);
+    // Run a normal query with departure_time 0 and do not target-prune to scan all connections,
+    // the reached trips are recorded in the trip records read by the backward scan
+    StopOffset source {source_id, 0};
+    StopOffset target {target_id, 0};
+    scan(trip_records, {&source, &source + 1}, {&target, &target + 1}, 0, false);
 
+    backward_scan(source_id, target_id, true);
+
+    return source_profile(source_id);
+}
+
+
+// The profile of the source computed by the backward scan. With the hub labels, the journeys can also start
+// by walking from the source to one of its out-hubs, whose profiles are merged into a copy, so that the profiles
+// of the other stops are left unchanged.
+ProfilePareto ConnectionScan::source_profile(const NodeID& source_id) const {
+    ProfilePareto profile = stop_profile[source_id];
+
+    if (use_hl) {
+        for (const auto& hub_link: _timetable->out_hubs(source_id)) {
+            if (hub_link.hub_id == source_id) continue;
+
+            for (const auto& pair: stop_profile[hub_link.hub_id]) {
+                if (pair.dep != INF && pair.dep >= hub_link.time) {
+                    profile.emplace(pair.dep - hub_link.time, pair.arr);
+                }
+            }
+        }
+    }
+
+    return profile;
+}
+
+
+// Without a source, all the trips are considered reached and no pair is pruned by source domination,
+// thus the profile of every stop to the target is complete at the end of the backward scan
+const std::vector<ProfilePareto>& ConnectionScan::all_to_one_profile(const NodeID& target_id) {
+    backward_scan(0, target_id, false);
+
+    return stop_profile;
+}
+
+
+// Compute the profiles to the target by scanning the connections in the decreasing order of departure time.
+// With a source, only the trips reached by the forward scan are used, and the pairs dominated by
+// the profile of the source are pruned.
+void ConnectionScan::backward_scan(const NodeID& source_id, const NodeID& target_id, const bool& has_source) {
     // Handle final footpaths
     if (!use_hl) {
-        for (const auto& transfer: _timetable->stops[target_id].backward_transfers) {
-            walking_time_to_target[transfer.target_id] = transfer.time;
+        // The backward transfers of the target all end at the target, they are walked from their source
+        for (const auto& transfer: _timetable->backward_transfers(target_id)) {
+            walking_time_to_target[transfer.source_id] = transfer.time;
         }
     } else {
-        for (const auto& hub_link: _timetable->stops[target_id].in_hubs) {
+        for (const auto& hub_link: _timetable->in_hubs(target_id)) {
             const auto& walking_time = hub_link.time;
             const auto& hub_id = hub_link.hub_id;
 
@@ -204,7 +438,7 @@ ProfilePareto ConnectionScan::profile_query(const NodeID& source_id,
         }
 
         for (const auto& stop: _timetable->stops) {
-            for (const auto& hub_link: stop.out_hubs) {
+            for (const auto& hub_link: _timetable->out_hubs(stop.id)) {
                 const auto& walking_time = hub_link.time;
                 const auto& hub_id = hub_link.hub_id;
 
@@ -222,22 +456,24 @@ ProfilePareto ConnectionScan::profile_query(const NodeID& source_id,
     // Iterate over the connection in the decreasing order by departure time
     for (auto conn_iter = first; conn_iter != last; ++conn_iter) {
         // Skip the connection if its trip was not reached during the normal query
-        if (!is_reached[conn_iter->trip_id]) {
-            continue;
+        if (!trip_records.is_reached(conn_iter->trip_id)) {
+            if (has_source) continue;
+
+            trip_records.mark_reached(conn_iter->trip_id);
         }
 
         // Arrival time when walking from the arrival stop to the target
         t1 = conn_iter->arrival_time + walking_time_to_target[conn_iter->arrival_stop_id];
 
         // Arrival time when remaining seated on the trip of the current connection
-        t2 = trip_earliest_time[conn_iter->trip_id];
+        t2 = trip_records.earliest_time(conn_iter->trip_id);
 
         // Arrival time when transferring
         t3 = arrival_time_from_node(conn_iter->arrival_stop_id, conn_iter->arrival_time);
 
         // Arrival time when walking to the out-hubs
         if (use_hl) {
-            for (const auto& hub_link: _timetable->stops[conn_iter->arrival_stop_id].out_hubs) {
+            for (const auto& hub_link: _timetable->out_hubs(conn_iter->arrival_stop_id)) {
                 // When walking from the arrival stop to the out-hub h, we arrive at h
                 // at time conn_iter->arrival_time + hub_link.time
                 t3h = arrival_time_from_node(hub_link.hub_id,
@@ -252,7 +488,7 @@ ProfilePareto ConnectionScan::profile_query(const NodeID& source_id,
         ProfilePareto::pair_t conn_pair {conn_iter->departure_time, t_conn};
 
         // Source domination
-        if (stop_profile[source_id].dominates(conn_pair)) {
+        if (has_source && stop_profile[source_id].dominates(conn_pair)) {
             continue;
         }
 
@@ -262,42 +498,46 @@ ProfilePareto ConnectionScan::profile_query(const NodeID& source_id,
             stop_profile[conn_iter->departure_stop_id].emplace(conn_pair, false);
 
             if (!use_hl) {
-                for (const auto& transfer: _timetable->stops[conn_iter->departure_stop_id].backward_transfers) {
-                    stop_profile[transfer.target_id].emplace(conn_iter->departure_time - transfer.time, t_conn);
+                for (const auto& transfer: _timetable->backward_transfers(conn_iter->departure_stop_id)) {
+                    stop_profile[transfer.source_id].emplace(conn_iter->departure_time - transfer.time, t_conn);
                 }
             } else {
-                for (const auto& hub_link: _timetable->stops[conn_iter->departure_stop_id].in_hubs) {
+                for (const auto& hub_link: _timetable->in_hubs(conn_iter->departure_stop_id)) {
                     stop_profile[hub_link.hub_id].emplace(conn_iter->departure_time - hub_link.time, t_conn);
                 }
             }
         }
 
-        trip_earliest_time[conn_iter->trip_id] = t_conn;
+        trip_records.set_earliest_time(conn_iter->trip_id, t_conn);
     }
-
-    return stop_profile[source_id];
 }
 
 
-// Arrival time at the target when we start from any node at a given arrival time at the node.
-// Since in the profile, both the departure time and arrival time are in decreasing order,
-// we only need to find the last pair with departure time at least the given arrival_time
-// TODO: compare the performance of linear search and binary search
+// Arrival time at the target when we start from any node at a given arrival time at the node
 Time ConnectionScan::arrival_time_from_node(const NodeID& node_id, const Time& arrival_time) {
-    ProfilePareto::pair_t p;
+    return stop_profile[node_id].arrival_time(arrival_time);
+}
 
-    auto first = stop_profile[node_id].rbegin();
-    auto last = stop_profile[node_id].rend();
 
-    for (auto iter = first; iter != last; ++iter) {
-        // We are iterating in the reverse order, starting from the back of the profile vector,
-        // thus the first profile pair with departure time >= the arrival time of the connection
-        // will be the pair we need
-        if (iter->dep >= arrival_time) {
-            p = *iter;
-            break;
+// The walking time from the source to the target without any connection, as used by the forward scan
+Time ConnectionScan::walking_time(const NodeID& source_id, const NodeID& target_id) const {
+    Time time {INF};
+
+    if (!use_hl) {
+        for (const auto& transfer: _timetable->transfers(source_id)) {
+            if (transfer.target_id == target_id) {
+                time = std::min(time, transfer.time);
+            }
+        }
+    } else {
+        for (const auto& out_link: _timetable->out_hubs(source_id)) {
+            for (const auto& in_link: _timetable->in_hubs(target_id)) {
+                if (out_link.hub_id == in_link.hub_id) {
+                    time = std::min(time, out_link.time + in_link.time);
+                }
+            }
         }
     }
 
-    return p.arr;
+    return time;
 }
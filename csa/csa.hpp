@@ -1,35 +1,100 @@
 #ifndef CSA_HPP
 #define CSA_HPP
 
+#include <memory>
 #include <vector>
 
 #include "data_structure.hpp"
 #include "profile_pareto.hpp"
+#include "timetable_store.hpp"
+#include "trip_state.hpp"
+
+// A stop near a geographic point, with the walking time between the point and the stop
+struct StopOffset {
+    NodeID stop_id;
+    Time time;
+};
+
 
 class ConnectionScan {
 private:
-    const Timetable* const _timetable;
+    const Timetable* _timetable;
+    const TimetableStore* const _store = nullptr;
+    const std::size_t _node = 0;
+
+    // The snapshot of the store used by the current query, kept alive until the next one starts
+    std::shared_ptr<const Timetable> _snapshot;
+    uint64_t _generation = 0;
     std::vector<Time> earliest_arrival_time;
-    std::vector<bool> is_reached;
+    std::vector<Time> latest_departure_time;
+    TripReachedBits trip_reached;
+    TripRecords trip_records;
     std::vector<ProfilePareto> stop_profile;
-    std::vector<Time> trip_earliest_time;
     std::vector<Time> walking_time_to_target;
 
+    template<class TripState>
+    Time scan(TripState& trip_state, const ArrayView<StopOffset>& sources, const ArrayView<StopOffset>& targets,
+              const Time& departure_time, const bool& target_pruning, const Time* lower_bounds = nullptr);
+
+    Time arrival_time_at_targets(const ArrayView<StopOffset>& targets) const;
+
+    void backward_scan(const NodeID& source_id, const NodeID& target_id, const bool& has_source);
+
     void update_using_in_hubs(const NodeID& dep_id);
 
-    void update_out_hubs(const NodeID& arr_id, const Time& arrival_time, const NodeID& target_id);
+    void update_out_hubs(const NodeID& arr_id, const Time& arrival_time, const Time& target_time);
 
     Time arrival_time_from_node(const NodeID& node_id, const Time& arrival_time);
 
+    void update_using_out_hubs(const NodeID& stop_id);
+
+    void update_in_hubs(const NodeID& dep_id, const Time& departure_time, const Time& source_time);
+
 public:
     explicit ConnectionScan(const Timetable* timetable_p) : _timetable {timetable_p} {};
 
+    // Each query runs on the latest snapshot of the store at the time init() is called,
+    // using the replica of the given NUMA node if the store is replicated
+    explicit ConnectionScan(const TimetableStore* store_p, const std::size_t& node = 0) :
+            _timetable {nullptr}, _store {store_p}, _node {node} {};
+
+    // With the lower bounds of the travel times of the stops to the target, the arrivals at the stops
+    // which cannot improve the arrival time at the target are skipped
     Time
     query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time,
-          const bool& target_pruning = true);
+          const bool& target_pruning = true, const std::vector<Time>* lower_bounds = nullptr);
+
+    // The earliest arrival time at a point behind the targets, when leaving a point in front of the sources
+    // at the departure time. Each source is reached and each target is left after its walking time.
+    Time query(const std::vector<StopOffset>& sources, const std::vector<StopOffset>& targets,
+               const Time& departure_time, const bool& target_pruning = true);
+
+    // The latest departure time from the source to arrive at the target not after the given time,
+    // or 0 if the target cannot be reached in time
+    Time latest_departure_query(const NodeID& source_id, const NodeID& target_id, const Time& arrival_time,
+                                const bool& source_pruning = true);
 
     ProfilePareto profile_query(const NodeID& source_id, const NodeID& target_id);
 
+    // The profiles of all the stops to the target, indexed by stop id and valid until clear(). With the hub
+    // labels, the profile of a source of a query is given by source_profile.
+    const std::vector<ProfilePareto>& all_to_one_profile(const NodeID& target_id);
+
+    // The profile of the source after profile_query or all_to_one_profile, including the journeys starting
+    // with a walk to an out-hub of the source
+    ProfilePareto source_profile(const NodeID& source_id) const;
+
+    Time walking_time(const NodeID& source_id, const NodeID& target_id) const;
+
+    // The timetable used by the current query
+    const Timetable& timetable() const { return *_timetable; }
+
+    // The snapshot of the store used by the current query, empty without a store
+    const std::shared_ptr<const Timetable>& snapshot() const { return _snapshot; }
+
+    // The generation of the snapshot in the store, the same on all the NUMA nodes, 0 without a store
+    const uint64_t& generation() const { return _generation; }
+
     void init();
 
     void clear();
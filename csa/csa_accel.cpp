@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "connection_profiles.hpp"
+#include "csa_accel.hpp"
+#include "csv.h"
+#include "gzstream.h"
+#include "hash.hpp"
+
+
+// The layout of the file of the preprocessing: a header followed by the cells of the stops
+// and the transit connections
+static const char accel_magic[8] = {'C', 'S', 'A', 'A', 'C', 'C', 'E', 'L'};
+static const uint32_t accel_version = 2;
+
+struct AccelHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_cells;
+    uint64_t hash;
+    uint64_t n_stops;
+    uint64_t n_transit_connections;
+};
+
+
+AcceleratedTimetable::AcceleratedTimetable(std::shared_ptr<const Timetable> timetable) :
+        _timetable {std::move(timetable)} {
+    n_cells = std::max<std::size_t>(std::min(cells, _timetable->stops.size()), 1);
+
+    auto hash = timetable_hash();
+    std::string file_path = _timetable->path + "csa_accel.bin";
+
+    if (load(file_path, hash)) {
+        std::cout << "Loaded " << transit_connections.size() << " transit connections from " << file_path << std::endl;
+    } else {
+        partition();
+
+        if (compute_transit_connections()) {
+            save(file_path, hash);
+        } else {
+            // Nothing is stored, and the stops are put in a single cell so that the queries scan all the connections
+            n_cells = 1;
+            stop_cell.assign(stop_cell.size(), 0);
+        }
+    }
+
+    // The local connections are grouped by cell the same way as the departures by stop
+    const auto& connections = _timetable->connections;
+    local_offsets.assign(n_cells + 1, 0);
+
+    auto for_each_cell = [&](const Connection& conn, const std::function<void(const uint32_t&)>& f) {
+        f(stop_cell[conn.departure_stop_id]);
+
+        if (stop_cell[conn.arrival_stop_id] != stop_cell[conn.departure_stop_id]) {
+            f(stop_cell[conn.arrival_stop_id]);
+        }
+    };
+
+    for (const auto& conn: connections) {
+        for_each_cell(conn, [&](const uint32_t& cell) { ++local_offsets[cell + 1]; });
+    }
+
+    for (std::size_t i = 1; i < local_offsets.size(); ++i) {
+        local_offsets[i] += local_offsets[i - 1];
+    }
+
+    std::vector<uint64_t> ends(local_offsets.begin(), local_offsets.end() - 1);
+    local_connections.resize(local_offsets.back());
+
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        for_each_cell(connections[i], [&](const uint32_t& cell) {
+            local_connections[ends[cell]++] = static_cast<ConnectionID>(i);
+        });
+    }
+}
+
+
+// The coordinates of the stops given by the file stop_positions.csv.gz of the dataset, which the generator writes,
+// empty if there is no such file or if a stop has no coordinates
+std::vector<AcceleratedTimetable::Position> AcceleratedTimetable::read_positions() const {
+    const auto n_stops = _timetable->stops.size();
+    std::string file_path = _timetable->path + "stop_positions.csv.gz";
+
+    if (!std::ifstream {file_path}) return {};
+
+    igzstream positions_file_stream {file_path.c_str()};
+    io::CSVReader<3> positions_reader {"stop_positions.csv", positions_file_stream};
+    positions_reader.read_header(io::ignore_extra_column, "stop_id", "x", "y");
+
+    std::vector<Position> positions(n_stops);
+    std::vector<bool> has_position(n_stops, false);
+
+    NodeID stop_id;
+    double x, y;
+
+    while (positions_reader.read_row(stop_id, x, y)) {
+        if (!_timetable->internal_stop_ids.empty() && stop_id >= _timetable->internal_stop_ids.size()) continue;
+
+        auto internal_id = _timetable->internal_stop_id(stop_id);
+
+        if (internal_id >= n_stops) continue;
+
+        positions[internal_id] = {x, y};
+        has_position[internal_id] = true;
+    }
+
+    if (std::find(has_position.begin(), has_position.end(), false) != has_position.end()) return {};
+
+    return positions;
+}
+
+
+// Split the stops into the given number of cells by cutting them recursively across the longer side of their
+// bounding box, each side of a cut getting a number of stops proportional to its number of cells
+static void bisect(std::vector<NodeID>::iterator first, std::vector<NodeID>::iterator last,
+                   const std::vector<AcceleratedTimetable::Position>& positions, const uint32_t& first_cell,
+                   const std::size_t& n_cells, std::vector<uint32_t>& stop_cell) {
+    if (n_cells <= 1 || last - first <= 1) {
+        for (auto iter = first; iter != last; ++iter) {
+            stop_cell[*iter] = first_cell;
+        }
+
+        return;
+    }
+
+    double min_x = positions[*first].x, max_x = min_x, min_y = positions[*first].y, max_y = min_y;
+
+    for (auto iter = first; iter != last; ++iter) {
+        min_x = std::min(min_x, positions[*iter].x);
+        max_x = std::max(max_x, positions[*iter].x);
+        min_y = std::min(min_y, positions[*iter].y);
+        max_y = std::max(max_y, positions[*iter].y);
+    }
+
+    const bool along_x = max_x - min_x >= max_y - min_y;
+    const std::size_t n_left_cells = n_cells / 2;
+    auto middle = first + (last - first) * n_left_cells / n_cells;
+
+    std::nth_element(first, middle, last, [&](const NodeID& s, const NodeID& t) {
+        return along_x ? positions[s].x < positions[t].x : positions[s].y < positions[t].y;
+    });
+
+    bisect(first, middle, positions, first_cell, n_left_cells, stop_cell);
+    bisect(middle, last, positions, static_cast<uint32_t>(first_cell + n_left_cells), n_cells - n_left_cells,
+           stop_cell);
+}
+
+
+// With the coordinates of the stops, the cells are compact regions of about the same number of stops. Otherwise
+// the cells are ranges of the stops in the order of a breadth-first search over the stops linked by a connection
+// or a footpath, so that each cell is a connected region of the network.
+void AcceleratedTimetable::partition() {
+    const auto n_stops = _timetable->stops.size();
+    const auto positions = read_positions();
+
+    stop_cell.resize(n_stops);
+
+    if (!positions.empty()) {
+        std::vector<NodeID> stop_ids;
+
+        for (const auto& stop: _timetable->stops) {
+            stop_ids.push_back(stop.id);
+        }
+
+        bisect(stop_ids.begin(), stop_ids.end(), positions, 0, n_cells, stop_cell);
+
+        return;
+    }
+
+    std::vector<std::vector<NodeID>> neighbours(n_stops);
+
+    for (const auto& conn: _timetable->connections) {
+        neighbours[conn.departure_stop_id].push_back(conn.arrival_stop_id);
+        neighbours[conn.arrival_stop_id].push_back(conn.departure_stop_id);
+    }
+
+    for (const auto& stop: _timetable->stops) {
+        for (const auto& transfer: _timetable->transfers(stop.id)) {
+            neighbours[transfer.source_id].push_back(transfer.target_id);
+            neighbours[transfer.target_id].push_back(transfer.source_id);
+        }
+    }
+
+    for (auto& stop_neighbours: neighbours) {
+        std::sort(stop_neighbours.begin(), stop_neighbours.end());
+        stop_neighbours.erase(std::unique(stop_neighbours.begin(), stop_neighbours.end()), stop_neighbours.end());
+    }
+
+    std::vector<NodeID> order;
+    std::vector<bool> visited(n_stops, false);
+
+    for (NodeID root = 0; root < n_stops; ++root) {
+        if (visited[root]) continue;
+
+        visited[root] = true;
+        order.push_back(root);
+
+        for (std::size_t i = order.size() - 1; i < order.size(); ++i) {
+            for (const auto& neighbour: neighbours[order[i]]) {
+                if (!visited[neighbour]) {
+                    visited[neighbour] = true;
+                    order.push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < n_stops; ++i) {
+        stop_cell[order[i]] = static_cast<uint32_t>(i * n_cells / n_stops);
+    }
+}
+
+
+// A backward profile scan to each border stop, as in ConnectionScan::all_to_one_profile, followed by the unpacking
+// of the journeys of the profiles of all the border stops, which are the journeys continuing a query after it
+// leaves the cell of its source. The connections of the journeys are marked, except those of the cell of a border
+// stop entered by connections, which are local to the queries using it. The border stops are handed out
+// to the threads one at a time. The computation stops once half of the connections are transit connections,
+// since every query would then scan all the connections anyway, and false is returned.
+bool AcceleratedTimetable::compute_transit_connections() {
+    const auto& connections = _timetable->connections;
+    const auto n_stops = _timetable->stops.size();
+
+    std::vector<bool> entered(n_stops, false);
+    std::vector<bool> walks_out(n_stops, false);
+
+    for (const auto& conn: connections) {
+        if (stop_cell[conn.departure_stop_id] != stop_cell[conn.arrival_stop_id]) {
+            entered[conn.arrival_stop_id] = true;
+        }
+    }
+
+    for (const auto& stop: _timetable->stops) {
+        for (const auto& transfer: _timetable->transfers(stop.id)) {
+            if (stop_cell[transfer.source_id] != stop_cell[transfer.target_id]) {
+                walks_out[transfer.source_id] = true;
+                entered[transfer.target_id] = true;
+            }
+        }
+    }
+
+    std::vector<NodeID> border_stops;
+
+    for (NodeID stop_id = 0; stop_id < n_stops; ++stop_id) {
+        if (entered[stop_id] || walks_out[stop_id]) border_stops.push_back(stop_id);
+    }
+
+    std::size_t n_workers = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<std::atomic<bool>> used(connections.size());
+    std::atomic<std::size_t> n_used {0};
+    std::atomic<std::size_t> next_border {0};
+
+    auto worker = [&]() {
+        ConnectionProfiles profiles {_timetable.get()};
+        std::vector<bool> visited(connections.size());
+
+        for (std::size_t i = next_border++; i < border_stops.size() && 2 * n_used < connections.size();
+             i = next_border++) {
+            const auto& target_id = border_stops[i];
+            uint32_t excluded_cell = walks_out[target_id] ? static_cast<uint32_t>(n_cells) : stop_cell[target_id];
+
+            profiles.scan(target_id);
+            std::fill(visited.begin(), visited.end(), false);
+
+            // A trip which was already visited continues the same way
+            auto mark = [&](const Time&, const ConnectionID& first_id, const ConnectionID& last_id) {
+                if (visited[first_id]) return false;
+
+                const auto& first_conn = connections[first_id];
+
+                for (const auto& id: _timetable->trip_connections(first_conn.trip_id, first_conn.stop_sequence)) {
+                    const auto& conn = connections[id];
+                    visited[id] = true;
+
+                    if (stop_cell[conn.departure_stop_id] != excluded_cell &&
+                        stop_cell[conn.arrival_stop_id] != excluded_cell && !used[id] && !used[id].exchange(true)) {
+                        ++n_used;
+                    }
+
+                    if (id == last_id) break;
+                }
+
+                return true;
+            };
+
+            for (const auto& stop_id: border_stops) {
+                for (const auto& pair: profiles.profile(stop_id)) {
+                    if (pair.dep != INF) profiles.unpack(pair.conn_id, 0, mark);
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (std::size_t worker_id = 0; worker_id < n_workers; ++worker_id) {
+        threads.emplace_back(worker);
+    }
+
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    if (2 * n_used >= connections.size()) {
+        std::cout << "More than half of the " << connections.size() << " connections are transit connections with "
+                  << n_cells << " cells and " << border_stops.size() << " border stops, the queries scan all the "
+                  << "connections" << std::endl;
+
+        return false;
+    }
+
+    for (std::size_t k = 0; k < connections.size(); ++k) {
+        if (used[k]) transit_connections.push_back(static_cast<ConnectionID>(k));
+    }
+
+    std::cout << "Computed " << transit_connections.size() << " transit connections out of " << connections.size()
+              << " with " << n_cells << " cells and " << border_stops.size() << " border stops" << std::endl;
+
+    return true;
+}
+
+
+// The hash of the connections, the footpaths and the number of cells
+uint64_t AcceleratedTimetable::timetable_hash() const {
+    auto hash = ::timetable_hash(*_timetable);
+    hash.add(n_cells);
+
+    return hash.value();
+}
+
+
+bool AcceleratedTimetable::load(const std::string& file_path, const uint64_t& hash) {
+    std::ifstream in {file_path, std::ios::binary};
+    AccelHeader header {};
+
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, accel_magic, sizeof(header.magic)) != 0 || header.version != accel_version ||
+        header.n_cells != n_cells || header.hash != hash || header.n_stops != _timetable->stops.size()) {
+        return false;
+    }
+
+    stop_cell.resize(header.n_stops);
+    transit_connections.resize(header.n_transit_connections);
+
+    in.read(reinterpret_cast<char*>(stop_cell.data()), static_cast<std::streamsize>(stop_cell.size() * sizeof(uint32_t)));
+    in.read(reinterpret_cast<char*>(transit_connections.data()),
+            static_cast<std::streamsize>(transit_connections.size() * sizeof(ConnectionID)));
+
+    if (!in) {
+        stop_cell.clear();
+        transit_connections.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+void AcceleratedTimetable::save(const std::string& file_path, const uint64_t& hash) const {
+    AccelHeader header {};
+    std::memcpy(header.magic, accel_magic, sizeof(header.magic));
+    header.version = accel_version;
+    header.n_cells = static_cast<uint32_t>(n_cells);
+    header.hash = hash;
+    header.n_stops = stop_cell.size();
+    header.n_transit_connections = transit_connections.size();
+
+    // Write to a temporary file first, so that other processes never read a partial preprocessing
+    std::string tmp_path = file_path + ".tmp" + std::to_string(getpid());
+    std::ofstream out {tmp_path, std::ios::binary | std::ios::trunc};
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(stop_cell.data()),
+              static_cast<std::streamsize>(stop_cell.size() * sizeof(uint32_t)));
+    out.write(reinterpret_cast<const char*>(transit_connections.data()),
+              static_cast<std::streamsize>(transit_connections.size() * sizeof(ConnectionID)));
+    out.close();
+
+    if (!out || std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+        std::cerr << "Error occurred while writing " << file_path << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        exit(1);
+    }
+}
+
+
+AcceleratedScan::AcceleratedScan(std::shared_ptr<const AcceleratedTimetable> cells) :
+        _cells {std::move(cells)}, _timetable {&_cells->timetable()} {
+    earliest_arrival_time.assign(_timetable->max_node_id + 1, INF);
+    trip_reached.resize(_timetable->max_trip_id + 1);
+}
+
+
+// The same steps as the loop of ConnectionScan::scan without hub labels
+inline void AcceleratedScan::scan_connection(const Connection& conn, const NodeID& target_id) {
+    if (!trip_reached.is_reached(conn.trip_id) && earliest_arrival_time[conn.departure_stop_id] > conn.departure_time) {
+        return;
+    }
+
+    trip_reached.mark_reached(conn.trip_id);
+
+    if (conn.arrival_time >= earliest_arrival_time[conn.arrival_stop_id]) return;
+
+    earliest_arrival_time[conn.arrival_stop_id] = conn.arrival_time;
+
+    for (const auto& transfer: _timetable->transfers(conn.arrival_stop_id)) {
+        Time tmp_time = conn.arrival_time + transfer.time;
+
+        if (tmp_time > earliest_arrival_time[target_id]) break;
+
+        if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+            earliest_arrival_time[transfer.target_id] = tmp_time;
+        }
+    }
+}
+
+
+Time AcceleratedScan::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time) {
+    std::fill(earliest_arrival_time.begin(), earliest_arrival_time.end(), INF);
+    trip_reached.reset();
+
+    for (const auto& transfer: _timetable->transfers(source_id)) {
+        earliest_arrival_time[transfer.target_id] = std::min(earliest_arrival_time[transfer.target_id],
+                                                             departure_time + transfer.time);
+    }
+
+    const auto& connections = _timetable->connections;
+    Connection dummy_conn {0, 0, 0, departure_time, departure_time, 0};
+    auto first_id = static_cast<ConnectionID>(
+            std::lower_bound(connections.begin(), connections.end(), dummy_conn) - connections.begin());
+
+    const auto& source_cell = _cells->stop_cell[source_id];
+    const auto& target_cell = _cells->stop_cell[target_id];
+    const auto& source_local = _cells->local(source_cell);
+    const auto& target_local = _cells->local(target_cell);
+    const auto& transit = _cells->transit_connections;
+
+    if (source_cell == target_cell || 2 * (source_local.size() + target_local.size() + transit.size()) >= connections.size()) {
+        for (auto i = first_id; i < connections.size(); ++i) {
+            if (earliest_arrival_time[target_id] <= connections[i].departure_time) break;
+
+            scan_connection(connections[i], target_id);
+        }
+
+        return earliest_arrival_time[target_id];
+    }
+
+    // Merge the three sorted lists of connection ids, a connection being in several of them at most once
+    const ConnectionID* lists[3][2] = {
+            {std::lower_bound(source_local.begin(), source_local.end(), first_id), source_local.end()},
+            {std::lower_bound(target_local.begin(), target_local.end(), first_id), target_local.end()},
+            {std::lower_bound(transit.data(), transit.data() + transit.size(), first_id), transit.data() + transit.size()}
+    };
+
+    while (true) {
+        ConnectionID next_id = UINT32_MAX;
+
+        for (const auto& list: lists) {
+            if (list[0] != list[1]) next_id = std::min(next_id, *list[0]);
+        }
+
+        if (next_id == UINT32_MAX) break;
+
+        for (auto& list: lists) {
+            if (list[0] != list[1] && *list[0] == next_id) ++list[0];
+        }
+
+        if (earliest_arrival_time[target_id] <= connections[next_id].departure_time) break;
+
+        scan_connection(connections[next_id], target_id);
+    }
+
+    return earliest_arrival_time[target_id];
+}
@@ -0,0 +1,83 @@
+#ifndef CSA_ACCEL_HPP
+#define CSA_ACCEL_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "data_structure.hpp"
+#include "trip_state.hpp"
+
+
+// The stops partitioned into cells, with the connections needed by the queries between the cells.
+// A journey to a stop of the target cell enters the cell for the last time at a border stop: a stop of the cell
+// reached by a connection from another cell, or a stop with a footpath to another cell. The part of the journey
+// before can be replaced by a Pareto-optimal journey to the border stop, and the part after only uses
+// connections of the target cell. Thus the queries only scan the connections departing or arriving in the cells
+// of the source and the target, and the transit connections used by the Pareto-optimal journeys to the border stops.
+class AcceleratedTimetable {
+public:
+    struct Position {
+        double x, y;
+    };
+
+private:
+    std::shared_ptr<const Timetable> _timetable;
+
+    std::vector<Position> read_positions() const;
+
+    void partition();
+
+    bool compute_transit_connections();
+
+    uint64_t timetable_hash() const;
+
+    bool load(const std::string& file_path, const uint64_t& hash);
+
+    void save(const std::string& file_path, const uint64_t& hash) const;
+
+public:
+    std::size_t n_cells;
+    std::vector<uint32_t> stop_cell;
+
+    // The connections departing or arriving in each cell in the order of the timetable, the connections
+    // of the cell c are between the offsets local_offsets[c] and local_offsets[c + 1]
+    std::vector<uint64_t> local_offsets;
+    std::vector<ConnectionID> local_connections;
+
+    std::vector<ConnectionID> transit_connections;
+
+    explicit AcceleratedTimetable(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _timetable; }
+
+    const Timetable& timetable() const { return *_timetable; }
+
+    ArrayView<ConnectionID> local(const uint32_t& cell) const {
+        return {local_connections.data() + local_offsets[cell], local_connections.data() + local_offsets[cell + 1]};
+    }
+};
+
+
+// The earliest arrival query scanning the local connections of the cells of the source and the target
+// together with the transit connections. The query falls back to scanning all the connections
+// when the source and the target are in the same cell, or when the merged connections are not much fewer.
+class AcceleratedScan {
+private:
+    std::shared_ptr<const AcceleratedTimetable> _cells;
+    const Timetable* _timetable;
+
+    std::vector<Time> earliest_arrival_time;
+    TripReachedBits trip_reached;
+
+    inline void scan_connection(const Connection& conn, const NodeID& target_id);
+
+public:
+    explicit AcceleratedScan(std::shared_ptr<const AcceleratedTimetable> cells);
+
+    const std::shared_ptr<const AcceleratedTimetable>& cells() const { return _cells; }
+
+    Time query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+};
+
+#endif // CSA_ACCEL_HPP
@@ -26,27 +26,68 @@ std::pair<CountMap<T>, CountMap<T>> find_indices(CountMap<T> counts) {
 }
 
 
+bool HubLabelView::compress(const HubLink* first, const HubLink* last, std::vector<uint32_t>& words) {
+    if (first == last) return false;
+
+    NodeID base = first->hub_id;
+    NodeID max_hub_id = first->hub_id;
+    Time max_time = 0;
+
+    for (auto hub_link = first; hub_link != last; ++hub_link) {
+        base = std::min(base, hub_link->hub_id);
+        max_hub_id = std::max(max_hub_id, hub_link->hub_id);
+        max_time = std::max(max_time, hub_link->time);
+    }
+
+    if (max_hub_id >= wide_flag) {
+        std::cerr << "Error occurred while compressing the hub labels, the hub id " << max_hub_id
+                  << " does not fit in 31 bits" << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        exit(1);
+    }
+
+    bool wide = max_hub_id - base > 0xFFFF || max_time > 0xFFFF;
+
+    words.push_back(wide ? base | wide_flag : base);
+
+    for (auto hub_link = first; hub_link != last; ++hub_link) {
+        if (wide) {
+            words.push_back(hub_link->hub_id - base);
+            words.push_back(hub_link->time);
+        } else {
+            words.push_back((hub_link->hub_id - base) | (hub_link->time << 16));
+        }
+    }
+
+    return wide;
+}
+
+
 void Timetable::parse_data() {
     Timer timer;
 
     std::cout << "Parsing the data..." << std::endl;
 
-    parse_stops();
+    TimetableData data;
+
+    parse_stops(data);
 
     if (use_hl) {
-        parse_hubs();
+        parse_hubs(data);
     } else {
-        parse_transfers();
+        parse_transfers(data);
     }
 
-    parse_connections();
+    parse_connections(data);
+
+    build(data);
 
     std::cout << "Complete parsing the data." << std::endl;
     std::cout << "Time elapsed: " << timer.elapsed() << timer.unit() << std::endl;
 }
 
 
-void Timetable::parse_stops() {
+void Timetable::parse_stops(TimetableData& data) {
     igzstream stop_routes_file_stream {(path + "stop_routes.csv.gz").c_str()};
     io::CSVReader<1> stop_routes_reader {"stop_routes.csv", stop_routes_file_stream};
     stop_routes_reader.read_header(io::ignore_extra_column, "stop_id");
@@ -54,18 +95,13 @@ void Timetable::parse_stops() {
     NodeID stop_id;
 
     while (stop_routes_reader.read_row(stop_id)) {
-
-        // Add a new stop if we encounter a new id, note that we might have a missing id.
-        while (stops.size() <= stop_id) {
-            stops.emplace_back(static_cast<NodeID>(stops.size()));
-        }
+        // Note that we might have a missing id, the stop is still created when building
+        data.n_stops = std::max(data.n_stops, static_cast<std::size_t>(stop_id) + 1);
     }
-
-    max_node_id = stops.back().id;
 }
 
 
-void Timetable::parse_transfers() {
+void Timetable::parse_transfers(TimetableData& data) {
     igzstream transfers_file_stream {(path + "transfers.csv.gz").c_str()};
     io::CSVReader<3> transfers_reader {"transfers.csv", transfers_file_stream};
     transfers_reader.read_header(io::ignore_no_column, "from_stop_id", "to_stop_id", "min_transfer_time");
@@ -74,30 +110,418 @@ void Timetable::parse_transfers() {
     NodeID target_id;
     Time time;
 
+    while (transfers_reader.read_row(source_id, target_id, time)) {
+        data.transfers.emplace_back(source_id, target_id, time);
+    }
+}
+
+
+void Timetable::parse_hubs(TimetableData& data) {
+    igzstream in_hubs_file_stream {(path + "in_hubs.gr.gz").c_str()};
+    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> in_hubs_reader {"in_hubs.gr", in_hubs_file_stream};
+    in_hubs_reader.set_header("node_id", "stop_id", "distance");
+
+    NodeID node_id;
+    NodeID stop_id;
+    Time walking_time;
+
+    while (in_hubs_reader.read_row(node_id, stop_id, walking_time)) {
+        data.in_hubs.emplace_back(stop_id, node_id, walking_time);
+    }
+
+    igzstream out_hubs_file_stream {(path + "out_hubs.gr.gz").c_str()};
+    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> out_hubs_reader {"out_hubs.gr", out_hubs_file_stream};
+    out_hubs_reader.set_header("stop_id", "node_id", "distance");
+
+    while (out_hubs_reader.read_row(stop_id, node_id, walking_time)) {
+        data.out_hubs.emplace_back(stop_id, node_id, walking_time);
+    }
+}
+
+
+void Timetable::parse_connections(TimetableData& data) {
+    igzstream stop_times_file_stream {(path + "stop_times.csv.gz").c_str()};
+    io::CSVReader<5> stop_times_reader {"stop_times.csv", stop_times_file_stream};
+    stop_times_reader.read_header(io::ignore_no_column, "trip_id", "arrival_time", "departure_time", "stop_id",
+                                  "stop_sequence");
+
+    TripID trip_id;
+    Time arr, dep;
+    NodeID stop_id;
+    int stop_sequence;
+
+    while (stop_times_reader.read_row(trip_id, arr, dep, stop_id, stop_sequence)) {
+        data.trip_events[trip_id].emplace_back(stop_id, arr, dep, stop_sequence);
+    }
+}
+
+
+void Timetable::build(TimetableData& data) {
+    // The connections are built first since they give the new order of the stops and trips
+    build_connections(data);
+
+    if (prune) {
+        prune_connections();
+    }
+
+    if (renumber) {
+        renumber_stops(data);
+        renumber_trips();
+    }
+
+    build_stops(data);
+
+    if (use_hl) {
+        build_hubs(data);
+    } else {
+        build_transfers(data);
+    }
+
+    index_connections();
+}
+
+
+// The array of the base timetable, borrowed if the base is the root or borrows it from the root, copied otherwise
+template<class T>
+static Array<T> share(const Array<T>& array, const bool& base_is_root) {
+    return base_is_root || array.is_borrowed() ? Array<T>::borrow(array.data(), array.size()) : array;
+}
+
+
+Timetable::Timetable(const std::shared_ptr<const Timetable>& base) :
+        _snapshot {base->_snapshot}, _root {base->_root ? base->_root : base}, path {base->path},
+        max_node_id {base->max_node_id}, max_trip_id {base->max_trip_id} {
+    const bool base_is_root = !base->_root;
+
+    _transfers = share(base->_transfers, base_is_root);
+    _backward_transfers = share(base->_backward_transfers, base_is_root);
+    _in_hubs = share(base->_in_hubs, base_is_root);
+    _out_hubs = share(base->_out_hubs, base_is_root);
+    _departures = share(base->_departures, base_is_root);
+    _trip_connections = share(base->_trip_connections, base_is_root);
+    _trip_offsets = share(base->_trip_offsets, base_is_root);
+    connections = share(base->connections, base_is_root);
+    stops = share(base->stops, base_is_root);
+    arrival_order = share(base->arrival_order, base_is_root);
+    original_stop_ids = share(base->original_stop_ids, base_is_root);
+    internal_stop_ids = share(base->internal_stop_ids, base_is_root);
+    original_trip_ids = share(base->original_trip_ids, base_is_root);
+    internal_trip_ids = share(base->internal_trip_ids, base_is_root);
+    original_hub_ids = share(base->original_hub_ids, base_is_root);
+}
+
+
+// The connections ordered lexicographically by arrival time, departure time, trip id, and the order
+// of the connection in the trip, which is the scan order of the latest departure query in reverse.
+// The departures of the stops are grouped by departure stop in a single array, since the connections
+// are sorted by departure time, the departures of each stop are sorted as well.
+void Timetable::index_connections() {
+    auto& departure_ids = _departures.vector();
+    auto& stop_vector = stops.vector();
+    std::vector<uint64_t> firsts(stops.size() + 1, 0);
+
+    for (const auto& conn: connections) {
+        ++firsts[conn.departure_stop_id + 1];
+    }
+
+    for (std::size_t i = 1; i < firsts.size(); ++i) {
+        firsts[i] += firsts[i - 1];
+    }
+
+    for (auto& stop: stop_vector) {
+        stop.departures = {firsts[stop.id], firsts[stop.id]};
+    }
+
+    departure_ids.resize(connections.size());
+
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        auto& stop = stop_vector[connections[i].departure_stop_id];
+        departure_ids[stop.departures.last++] = static_cast<ConnectionID>(i);
+    }
+
+    // The trips are grouped the same way, then the connections of each trip are sorted by stop sequence
+    auto& trip_ids = _trip_connections.vector();
+    auto& trip_offsets = _trip_offsets.vector();
+
+    trip_offsets.assign(max_trip_id + 2, 0);
+
+    for (const auto& conn: connections) {
+        ++trip_offsets[conn.trip_id + 1];
+    }
+
+    for (std::size_t i = 1; i < trip_offsets.size(); ++i) {
+        trip_offsets[i] += trip_offsets[i - 1];
+    }
+
+    std::vector<ConnectionID> trip_ends(trip_offsets.begin(), trip_offsets.end() - 1);
+    trip_ids.resize(connections.size());
+
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        trip_ids[trip_ends[connections[i].trip_id]++] = static_cast<ConnectionID>(i);
+    }
+
+    for (std::size_t trip_id = 0; trip_id + 1 < trip_offsets.size(); ++trip_id) {
+        std::sort(trip_ids.begin() + trip_offsets[trip_id], trip_ids.begin() + trip_offsets[trip_id + 1],
+                  [&](const ConnectionID& i, const ConnectionID& j) {
+                      return connections[i].stop_sequence < connections[j].stop_sequence;
+                  });
+    }
+
+    auto& order = arrival_order.vector();
+
+    order.resize(connections.size());
+
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<ConnectionID>(i);
+    }
+
+    std::sort(order.begin(), order.end(), [&](const ConnectionID& i, const ConnectionID& j) {
+        return arrives_before(connections[i], connections[j]);
+    });
+}
+
+
+using Window = std::pair<std::size_t, std::size_t>;
+
+
+// Sort the windows [first, last) and merge the overlapping ones
+static void merge_windows(std::vector<Window>& windows) {
+    std::sort(windows.begin(), windows.end());
+
+    std::vector<Window> merged;
+
+    for (const auto& window: windows) {
+        if (!merged.empty() && window.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, window.second);
+        } else {
+            merged.push_back(window);
+        }
+    }
+
+    windows.swap(merged);
+}
+
+
+// A retimed connection can only move between the positions of its old and new times in the connection array
+// and in the arrival order, thus only the windows of positions between them are sorted again, and the indexes
+// are patched at the positions of the moved connections. A window holds the same connections before and after
+// the sort, so the departures of each stop in a window keep their slots in the departure index.
+void Timetable::retime_connections(const std::vector<Connection>& retimed) {
+    std::vector<std::pair<ConnectionID, Connection>> changes;
+    std::vector<Window> departure_windows;
+    std::vector<Window> arrival_windows;
+
+    auto arrival_lower = [&](const ConnectionID& i, const Connection& conn) {
+        return arrives_before(connections[i], conn);
+    };
+    auto arrival_upper = [&](const Connection& conn, const ConnectionID& i) {
+        return arrives_before(conn, connections[i]);
+    };
+
+    for (const auto& conn: retimed) {
+        auto trip = trip_connections(conn.trip_id, conn.stop_sequence);
+
+        if (trip.size() == 0 || connections[*trip.begin()].stop_sequence != conn.stop_sequence) continue;
+
+        const ConnectionID i = *trip.begin();
+        const Connection& old_conn = connections[i];
+
+        if (old_conn == conn) continue;
+
+        changes.emplace_back(i, conn);
+
+        const Connection& first = conn < old_conn ? conn : old_conn;
+        const Connection& last = conn < old_conn ? old_conn : conn;
+
+        departure_windows.emplace_back(std::lower_bound(connections.begin(), connections.end(), first) -
+                                       connections.begin(),
+                                       std::upper_bound(connections.begin(), connections.end(), last) -
+                                       connections.begin());
+
+        const Connection& first_arrival = arrives_before(conn, old_conn) ? conn : old_conn;
+        const Connection& last_arrival = arrives_before(conn, old_conn) ? old_conn : conn;
+
+        arrival_windows.emplace_back(std::lower_bound(arrival_order.begin(), arrival_order.end(), first_arrival,
+                                                      arrival_lower) - arrival_order.begin(),
+                                     std::upper_bound(arrival_order.begin(), arrival_order.end(), last_arrival,
+                                                      arrival_upper) - arrival_order.begin());
+    }
+
+    if (changes.empty()) return;
+
+    merge_windows(departure_windows);
+    merge_windows(arrival_windows);
+
+    std::size_t n_moved = 0;
+
+    for (const auto& window: departure_windows) {
+        n_moved += window.second - window.first;
+    }
+
+    // Patching the indexes costs a binary search for each connection of the windows, which is slower than
+    // building them again once the windows cover a large part of the connections
+    const bool reindex = 4 * n_moved > connections.size();
+
+    // The slots of the connections of the windows in the trip index and in the arrival order,
+    // found with their old times
+    std::vector<std::size_t> trip_slots;
+    std::vector<std::size_t> arrival_slots;
+
+    for (const auto& window: departure_windows) {
+        for (std::size_t i = window.first; i < window.second && !reindex; ++i) {
+            const auto& conn = connections[i];
+
+            trip_slots.push_back(trip_connections(conn.trip_id, conn.stop_sequence).begin() -
+                                 _trip_connections.data());
+            arrival_slots.push_back(std::lower_bound(arrival_order.begin(), arrival_order.end(), conn,
+                                                     arrival_lower) - arrival_order.begin());
+        }
+    }
+
+    auto& connection_vector = connections.vector();
+    auto& departure_ids = _departures.vector();
+    auto& trip_ids = _trip_connections.vector();
+    auto& order = arrival_order.vector();
+
+    std::sort(changes.begin(), changes.end(), [](const std::pair<ConnectionID, Connection>& change1,
+                                                 const std::pair<ConnectionID, Connection>& change2) {
+        return change1.first < change2.first;
+    });
+
+    std::vector<ConnectionID> changed_ids;
+
+    for (const auto& change: changes) {
+        connection_vector[change.first] = change.second;
+        changed_ids.push_back(change.first);
+    }
+
+    auto is_changed = [&](const std::vector<ConnectionID>& ids, const std::size_t& i) {
+        return std::binary_search(ids.begin(), ids.end(), i);
+    };
+
+    // The new positions of the retimed connections
+    std::vector<ConnectionID> retimed_ids;
+    std::size_t slot = 0;
+
+    for (const auto& window: departure_windows) {
+        // The old position of the connection at each position of the window once sorted. The other connections
+        // of the window are still in order, thus the retimed ones are sorted apart and merged with them.
+        std::vector<ConnectionID> kept;
+        std::vector<ConnectionID> changed;
+
+        for (std::size_t i = window.first; i < window.second; ++i) {
+            (is_changed(changed_ids, i) ? changed : kept).push_back(static_cast<ConnectionID>(i));
+        }
+
+        auto less = [&](const ConnectionID& i, const ConnectionID& j) {
+            return connection_vector[i] < connection_vector[j];
+        };
+
+        std::sort(changed.begin(), changed.end(), less);
+
+        std::vector<ConnectionID> moved(window.second - window.first);
+        std::merge(kept.begin(), kept.end(), changed.begin(), changed.end(), moved.begin(), less);
+
+        std::vector<Connection> sorted;
+        std::vector<ConnectionID> new_position(moved.size());
+
+        for (std::size_t k = 0; k < moved.size(); ++k) {
+            sorted.push_back(connection_vector[moved[k]]);
+            new_position[moved[k] - window.first] = static_cast<ConnectionID>(window.first + k);
+
+            if (is_changed(changed_ids, moved[k])) retimed_ids.push_back(new_position[moved[k] - window.first]);
+        }
+
+        std::copy(sorted.begin(), sorted.end(), connection_vector.begin() + window.first);
+
+        if (reindex) continue;
+
+        for (std::size_t k = 0; k < moved.size(); ++k, ++slot) {
+            trip_ids[trip_slots[slot]] = new_position[k];
+            order[arrival_slots[slot]] = new_position[k];
+        }
+
+        // The departures of each stop in the window are rewritten from the first of their slots in the window
+        std::unordered_map<NodeID, std::size_t> next_slot;
+
+        for (std::size_t i = window.first; i < window.second; ++i) {
+            const auto& stop = stops[connection_vector[i].departure_stop_id];
+            auto iter = next_slot.find(stop.id);
+
+            if (iter == next_slot.end()) {
+                auto first = std::lower_bound(departure_ids.begin() + stop.departures.first,
+                                              departure_ids.begin() + stop.departures.last, window.first);
+                iter = next_slot.emplace(stop.id, first - departure_ids.begin()).first;
+            }
+
+            departure_ids[iter->second++] = static_cast<ConnectionID>(i);
+        }
+    }
+
+    if (reindex) {
+        index_connections();
+        return;
+    }
+
+    std::sort(retimed_ids.begin(), retimed_ids.end());
+
+    for (const auto& window: arrival_windows) {
+        std::vector<ConnectionID> kept;
+        std::vector<ConnectionID> changed;
+
+        for (std::size_t k = window.first; k < window.second; ++k) {
+            (is_changed(retimed_ids, order[k]) ? changed : kept).push_back(order[k]);
+        }
+
+        auto less = [&](const ConnectionID& i, const ConnectionID& j) {
+            return arrives_before(connection_vector[i], connection_vector[j]);
+        };
+
+        std::sort(changed.begin(), changed.end(), less);
+        std::merge(kept.begin(), kept.end(), changed.begin(), changed.end(), order.begin() + window.first, less);
+    }
+}
+
+
+void Timetable::build_stops(const TimetableData& data) {
+    auto& stop_vector = stops.vector();
+
+    for (std::size_t stop_id = 0; stop_id < data.n_stops; ++stop_id) {
+        stop_vector.emplace_back(static_cast<NodeID>(stop_id));
+    }
+
+    max_node_id = stops.empty() ? 0 : stops.back().id;
+}
+
+
+void Timetable::build_transfers(TimetableData& data) {
     std::map<NodeID, size_t> source_count;
     std::map<NodeID, size_t> target_count;
 
-    while (transfers_reader.read_row(source_id, target_id, time)) {
-        _transfers.emplace_back(source_id, target_id, time);
+    auto& transfers = _transfers.vector();
+    auto& backward_transfers = _backward_transfers.vector();
 
-        source_count[source_id] += 1;
-        target_count[target_id] += 1;
+    transfers.assign(data.transfers.begin(), data.transfers.end());
 
-        max_node_id = std::max(max_node_id, static_cast<std::size_t>(source_id));
-        max_node_id = std::max(max_node_id, static_cast<std::size_t>(target_id));
+    for (const auto& transfer: transfers) {
+        source_count[transfer.source_id] += 1;
+        target_count[transfer.target_id] += 1;
+
+        max_node_id = std::max(max_node_id, static_cast<std::size_t>(transfer.source_id));
+        max_node_id = std::max(max_node_id, static_cast<std::size_t>(transfer.target_id));
     }
 
-    _backward_transfers = _transfers;
+    backward_transfers = transfers;
 
     // We need to sort by source_id first to collect transfers having the same source_id
-    std::sort(_transfers.begin(), _transfers.end(),
+    std::sort(transfers.begin(), transfers.end(),
               [](const Transfer& t1, const Transfer& t2) {
                   return std::make_tuple(t1.source_id, t1.time, t1.target_id) <
                          std::make_tuple(t2.source_id, t2.time, t2.target_id);
               });
 
     // Sort by target_id first to collect backward transfers having the same target_id
-    std::sort(_backward_transfers.begin(), _backward_transfers.end(),
+    std::sort(backward_transfers.begin(), backward_transfers.end(),
               [](const Transfer& t1, const Transfer& t2) {
                   return std::make_tuple(t1.target_id, t1.time, t1.source_id) <
                          std::make_tuple(t2.target_id, t2.time, t2.source_id);
@@ -108,112 +532,121 @@ void Timetable::parse_transfers() {
     auto firsts = indices_pair.first;
     auto lasts = indices_pair.second;
 
-    for (auto& stop: stops) {
-        stop.transfers = {_transfers, firsts[stop.id], lasts[stop.id]};
+    for (auto& stop: stops.vector()) {
+        stop.transfers = {firsts[stop.id], lasts[stop.id]};
     }
 
     indices_pair = find_indices(target_count);
     firsts = indices_pair.first;
     lasts = indices_pair.second;
 
-    for (auto& stop: stops) {
-        stop.backward_transfers = {_backward_transfers, firsts[stop.id], lasts[stop.id]};
+    for (auto& stop: stops.vector()) {
+        stop.backward_transfers = {firsts[stop.id], lasts[stop.id]};
     }
 }
 
 
-void Timetable::parse_hubs() {
-    igzstream in_hubs_file_stream {(path + "in_hubs.gr.gz").c_str()};
-    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> in_hubs_reader {"in_hubs.gr", in_hubs_file_stream};
-    in_hubs_reader.set_header("node_id", "stop_id", "distance");
-
-    NodeID node_id;
-    NodeID stop_id;
-    Time walking_time;
-
-    std::map<NodeID, size_t> in_hubs_stop_count;
+void Timetable::build_hubs(TimetableData& data) {
+    auto& in_hubs = data.in_hubs;
+    auto& out_hubs = data.out_hubs;
 
-    while (in_hubs_reader.read_row(node_id, stop_id, walking_time)) {
-        in_hubs_stop_count[stop_id] += 1;
-
-        if (node_id > max_node_id) {
-            max_node_id = node_id;
-        }
+    compact_hub_ids(in_hubs, out_hubs);
 
-        _in_hubs.emplace_back(stop_id, node_id, walking_time);
+    for (const auto& hub_link: in_hubs) {
+        max_node_id = std::max(max_node_id, static_cast<std::size_t>(hub_link.hub_id));
     }
 
-    igzstream out_hubs_file_stream {(path + "out_hubs.gr.gz").c_str()};
-    io::CSVReader<3, io::trim_chars<>, io::no_quote_escape<' '>> out_hubs_reader {"out_hubs.gr", out_hubs_file_stream};
-    out_hubs_reader.set_header("stop_id", "node_id", "distance");
-
-    std::map<NodeID, size_t> out_hubs_stop_count;
-
-    while (out_hubs_reader.read_row(stop_id, node_id, walking_time)) {
-        out_hubs_stop_count[stop_id] += 1;
-
-        if (node_id > max_node_id) {
-            max_node_id = node_id;
-        }
-
-        _out_hubs.emplace_back(stop_id, node_id, walking_time);
+    for (const auto& hub_link: out_hubs) {
+        max_node_id = std::max(max_node_id, static_cast<std::size_t>(hub_link.hub_id));
     }
 
-    std::sort(_in_hubs.begin(), _in_hubs.end(),
+    std::sort(in_hubs.begin(), in_hubs.end(),
               [](const HubLink& t1, const HubLink& t2) {
                   return std::make_tuple(t1.stop_id, t1.time, t1.hub_id) <
                          std::make_tuple(t2.stop_id, t2.time, t2.hub_id);
               });
 
-    std::sort(_out_hubs.begin(), _out_hubs.end(),
+    std::sort(out_hubs.begin(), out_hubs.end(),
               [](const HubLink& t1, const HubLink& t2) {
                   return std::make_tuple(t1.stop_id, t1.time, t1.hub_id) <
                          std::make_tuple(t2.stop_id, t2.time, t2.hub_id);
               });
 
-    // Compute the cumulative sum from the counts
-    auto indices_pair = find_indices(in_hubs_stop_count);
-    auto firsts = indices_pair.first;
-    auto lasts = indices_pair.second;
+    // The labels of each stop are compressed into a block of words, see HubLabelView
+    auto compress = [&](const std::vector<HubLink>& hub_links, Array<uint32_t>& words, Range Stop::* range) {
+        std::vector<uint32_t> block_words;
+
+        for (auto& stop: stops.vector()) {
+            auto first = std::lower_bound(hub_links.begin(), hub_links.end(), stop.id,
+                                          [](const HubLink& hub_link, const NodeID& stop_id) {
+                                              return hub_link.stop_id < stop_id;
+                                          });
+            auto last = std::upper_bound(first, hub_links.end(), stop.id,
+                                         [](const NodeID& stop_id, const HubLink& hub_link) {
+                                             return stop_id < hub_link.stop_id;
+                                         });
+
+            (stop.*range).first = block_words.size();
+            HubLabelView::compress(hub_links.data() + (first - hub_links.begin()),
+                                   hub_links.data() + (last - hub_links.begin()), block_words);
+            (stop.*range).last = block_words.size();
+        }
 
-    for (auto& stop: stops) {
-        stop.in_hubs = {_in_hubs, firsts[stop.id], lasts[stop.id]};
-    }
+        words = Array<uint32_t>(block_words);
+    };
+
+    compress(in_hubs, _in_hubs, &Stop::in_hubs);
+    compress(out_hubs, _out_hubs, &Stop::out_hubs);
+}
 
-    indices_pair = find_indices(out_hubs_stop_count);
-    firsts = indices_pair.first;
-    lasts = indices_pair.second;
 
-    for (auto& stop: stops) {
-        stop.out_hubs = {_out_hubs, firsts[stop.id], lasts[stop.id]};
+// Remap the road nodes used as hubs to a dense range of ids directly after the stops, so that
+// the per-query states are sized to the stops and the used hubs, instead of the whole road graph.
+// The hub ids smaller than the number of stops are the stops themselves and are kept.
+void Timetable::compact_hub_ids(std::vector<HubLink>& in_hubs, std::vector<HubLink>& out_hubs) {
+    const auto n_stops = static_cast<NodeID>(stops.size());
+    auto& hub_ids = original_hub_ids.vector();
+    hub_ids.clear();
+
+    for (const auto& hub_link: in_hubs) {
+        if (hub_link.hub_id >= n_stops) hub_ids.push_back(hub_link.hub_id);
     }
-}
 
+    for (const auto& hub_link: out_hubs) {
+        if (hub_link.hub_id >= n_stops) hub_ids.push_back(hub_link.hub_id);
+    }
 
-void Timetable::parse_connections() {
-    igzstream stop_times_file_stream {(path + "stop_times.csv.gz").c_str()};
-    io::CSVReader<5> stop_times_reader {"stop_times.csv", stop_times_file_stream};
-    stop_times_reader.read_header(io::ignore_no_column, "trip_id", "arrival_time", "departure_time", "stop_id",
-                                  "stop_sequence");
+    // Keep the order of the original ids, which usually reflects the locality in the road graph
+    std::sort(hub_ids.begin(), hub_ids.end());
+    hub_ids.erase(std::unique(hub_ids.begin(), hub_ids.end()), hub_ids.end());
 
-    TripID trip_id;
-    Time arr, dep;
-    NodeID stop_id;
-    int stop_sequence;
+    auto new_id = [&](const NodeID& hub_id) {
+        if (hub_id < n_stops) return hub_id;
 
-    std::unordered_map<TripID, Events> trip_events;
+        auto iter = std::lower_bound(hub_ids.begin(), hub_ids.end(), hub_id);
+        return static_cast<NodeID>(n_stops + (iter - hub_ids.begin()));
+    };
 
-    while (stop_times_reader.read_row(trip_id, arr, dep, stop_id, stop_sequence)) {
-        trip_events[trip_id].emplace_back(stop_id, arr, dep, stop_sequence);
+    for (auto& hub_link: in_hubs) {
+        hub_link.hub_id = new_id(hub_link.hub_id);
+    }
 
-        max_trip_id = std::max(max_trip_id, static_cast<std::size_t>(trip_id));
+    for (auto& hub_link: out_hubs) {
+        hub_link.hub_id = new_id(hub_link.hub_id);
     }
+}
+
+
+void Timetable::build_connections(const TimetableData& data) {
+    auto& connection_vector = connections.vector();
 
-    for (const auto& kv: trip_events) {
-        trip_id = kv.first;
-        Events events = kv.second;
+    for (const auto& kv: data.trip_events) {
+        TripID trip_id = kv.first;
+        const Events& events = kv.second;
 
-        for (size_t i = 0; i < events.size() - 1; ++i) {
+        max_trip_id = std::max(max_trip_id, static_cast<std::size_t>(trip_id));
+
+        for (size_t i = 0; i + 1 < events.size(); ++i) {
             NodeID departure_stop_id = events[i].stop_id;
             NodeID arrival_stop_id = events[i + 1].stop_id;
 
@@ -222,13 +655,212 @@ void Timetable::parse_connections() {
 
             int seq = events[i].stop_sequence;
 
-            connections.emplace_back(trip_id, departure_stop_id, arrival_stop_id, departure_time, arrival_time, seq);
+            connection_vector.emplace_back(trip_id, departure_stop_id, arrival_stop_id,
+                                           departure_time, arrival_time, seq);
         }
     }
 
-    std::sort(connections.begin(), connections.end());
+    std::sort(connection_vector.begin(), connection_vector.end());
 }
 
+
+// Remove the connections dominated by another connection between the same stops, which departs not before
+// and arrives not after it. A journey using a dominated connection can take the other one instead and board
+// the next connection of its trip at the arrival stop, thus the earliest arrival times, the latest departure
+// times and the profiles are unchanged. Among equal connections the first one is kept. The trips lose
+// their dominated connections, thus the delays of DelayUpdater cannot be applied to a pruned timetable.
+void Timetable::prune_connections() {
+    auto& connection_vector = connections.vector();
+    std::vector<ConnectionID> order(connection_vector.size());
+
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<ConnectionID>(i);
+    }
+
+    // Between the same stops, the connections are visited by decreasing departure time, then increasing arrival time
+    std::sort(order.begin(), order.end(), [&](const ConnectionID& i, const ConnectionID& j) {
+        const Connection& conn1 = connection_vector[i];
+        const Connection& conn2 = connection_vector[j];
+
+        return std::make_tuple(conn1.departure_stop_id, conn1.arrival_stop_id, conn2.departure_time,
+                               conn1.arrival_time, i) <
+               std::make_tuple(conn2.departure_stop_id, conn2.arrival_stop_id, conn1.departure_time,
+                               conn2.arrival_time, j);
+    });
+
+    std::vector<bool> dominated(connection_vector.size(), false);
+    Time earliest_arrival_time {INF};
+
+    for (std::size_t k = 0; k < order.size(); ++k) {
+        const Connection& conn = connection_vector[order[k]];
+
+        if (k == 0 || conn.departure_stop_id != connection_vector[order[k - 1]].departure_stop_id ||
+            conn.arrival_stop_id != connection_vector[order[k - 1]].arrival_stop_id) {
+            earliest_arrival_time = INF;
+        }
+
+        if (conn.arrival_time >= earliest_arrival_time) {
+            dominated[order[k]] = true;
+        } else {
+            earliest_arrival_time = conn.arrival_time;
+        }
+    }
+
+    std::size_t n_kept {0};
+
+    for (std::size_t i = 0; i < connection_vector.size(); ++i) {
+        if (!dominated[i]) {
+            connection_vector[n_kept++] = connection_vector[i];
+        }
+    }
+
+    std::cout << "Pruned " << connection_vector.size() - n_kept << " dominated connections out of "
+              << connection_vector.size() << std::endl;
+
+    connection_vector.erase(connection_vector.begin() + n_kept, connection_vector.end());
+}
+
+
+// Renumber the stops in the order of their first appearance in the connection array, so that
+// the stops touched by connections scanned close to each other have close ids. The stops
+// without any connection are numbered last. The ids of the road nodes are left unchanged.
+void Timetable::renumber_stops(TimetableData& data) {
+    const auto n_stops = static_cast<NodeID>(data.n_stops);
+    const auto unassigned = static_cast<NodeID>(-1);
+    std::vector<NodeID> new_stop_ids(n_stops, unassigned);
+    std::vector<NodeID> old_stop_ids;
+
+    auto assign = [&](const NodeID& stop_id) {
+        if (new_stop_ids[stop_id] == unassigned) {
+            new_stop_ids[stop_id] = static_cast<NodeID>(old_stop_ids.size());
+            old_stop_ids.push_back(stop_id);
+        }
+    };
+
+    for (const auto& conn: connections) {
+        assign(conn.departure_stop_id);
+        assign(conn.arrival_stop_id);
+    }
+
+    for (NodeID stop_id = 0; stop_id < n_stops; ++stop_id) {
+        assign(stop_id);
+    }
+
+    original_stop_ids = old_stop_ids;
+    internal_stop_ids = new_stop_ids;
+
+    auto new_id = [&](const NodeID& node_id) {
+        return node_id < n_stops ? new_stop_ids[node_id] : node_id;
+    };
+
+    for (auto& conn: connections.vector()) {
+        conn = {conn.trip_id, new_id(conn.departure_stop_id), new_id(conn.arrival_stop_id),
+                conn.departure_time, conn.arrival_time, conn.stop_sequence};
+    }
+
+    for (auto& transfer: data.transfers) {
+        transfer = {new_id(transfer.source_id), new_id(transfer.target_id), transfer.time};
+    }
+
+    for (auto& hub_link: data.in_hubs) {
+        hub_link = {new_id(hub_link.stop_id), new_id(hub_link.hub_id), hub_link.time};
+    }
+
+    for (auto& hub_link: data.out_hubs) {
+        hub_link = {new_id(hub_link.stop_id), new_id(hub_link.hub_id), hub_link.time};
+    }
+}
+
+
+// Renumber the trips in the order of their first departure, so that the trips scanned
+// close to each other in the connection array have close ids, and their states are
+// likely to be in the same cache lines
+void Timetable::renumber_trips() {
+    std::vector<TripID> new_trip_ids(max_trip_id + 1, static_cast<TripID>(-1));
+    std::vector<TripID> old_trip_ids;
+    auto& connection_vector = connections.vector();
+
+    for (const auto& conn: connection_vector) {
+        if (new_trip_ids[conn.trip_id] == static_cast<TripID>(-1)) {
+            new_trip_ids[conn.trip_id] = static_cast<TripID>(old_trip_ids.size());
+            old_trip_ids.push_back(conn.trip_id);
+        }
+    }
+
+    for (auto& conn: connection_vector) {
+        conn = {new_trip_ids[conn.trip_id], conn.departure_stop_id, conn.arrival_stop_id,
+                conn.departure_time, conn.arrival_time, conn.stop_sequence};
+    }
+
+    // The trip id is used to break ties in the order of the connections
+    std::sort(connection_vector.begin(), connection_vector.end());
+
+    max_trip_id = old_trip_ids.empty() ? 0 : old_trip_ids.size() - 1;
+    original_trip_ids = old_trip_ids;
+    internal_trip_ids = new_trip_ids;
+}
+
+
+ArrayView<ConnectionID> Timetable::trip_connections(const TripID& trip_id, const int& from_stop_sequence) const {
+    const ConnectionID* first = _trip_connections.data() + _trip_offsets[trip_id];
+    const ConnectionID* last = _trip_connections.data() + _trip_offsets[trip_id + 1];
+
+    first = std::lower_bound(first, last, from_stop_sequence, [&](const ConnectionID& i, const int& stop_sequence) {
+        return connections[i].stop_sequence < stop_sequence;
+    });
+
+    return {first, last};
+}
+
+
+bool Timetable::transfers_closed() const {
+    // The walking time from the current stop to each node, INF if there is no footpath
+    std::vector<Time> direct_time(max_node_id + 1, INF);
+
+    for (const auto& stop: stops) {
+        for (const auto& transfer: transfers(stop.id)) {
+            direct_time[transfer.target_id] = std::min(direct_time[transfer.target_id], transfer.time);
+        }
+
+        for (const auto& first: transfers(stop.id)) {
+            for (const auto& second: transfers(first.target_id)) {
+                if (first.time + second.time < direct_time[second.target_id]) return false;
+            }
+        }
+
+        for (const auto& transfer: transfers(stop.id)) {
+            direct_time[transfer.target_id] = INF;
+        }
+    }
+
+    return true;
+}
+
+
+ArrayView<ConnectionID> Timetable::departures_between(const NodeID& stop_id, const Time& first_time,
+                                                      const Time& last_time) const {
+    auto stop_departures = departures(stop_id);
+
+    auto departs_before = [&](const ConnectionID& i, const Time& time) {
+        return connections[i].departure_time < time;
+    };
+
+    auto first = std::lower_bound(stop_departures.begin(), stop_departures.end(), first_time, departs_before);
+    auto last = std::lower_bound(first, stop_departures.end(), last_time, departs_before);
+
+    return {first, last};
+}
+
+
+ArrayView<ConnectionID> Timetable::next_departures(const NodeID& stop_id, const Time& time,
+                                                   const std::size_t& max_count) const {
+    auto window = departures_between(stop_id, time, INF);
+    auto count = std::min(window.size(), max_count);
+
+    return {window.begin(), window.begin() + count};
+}
+
+
 void Timetable::summary() const {
     std::cout << std::string(80, '-') << std::endl;
 
@@ -236,7 +868,11 @@ void Timetable::summary() const {
     std::cout << "Name: " << name << std::endl;
 
     size_t count_transfers = _transfers.size();
-    size_t count_hubs = _in_hubs.size() + _out_hubs.size();
+    size_t count_hubs = 0;
+
+    for (const auto& stop: stops) {
+        count_hubs += in_hubs(stop.id).size() + out_hubs(stop.id).size();
+    }
 
     std::cout << stops.size() << " stops" << std::endl;
 
@@ -244,11 +880,18 @@ void Timetable::summary() const {
         std::cout.setf(std::ios::fixed, std::ios::floatfield);
         std::cout.precision(3);
         std::cout << count_hubs / static_cast<double>(stops.size()) << " hubs in average" << std::endl;
+        std::cout << original_hub_ids.size() << " road nodes used as hubs" << std::endl;
+        std::cout << (_in_hubs.size() + _out_hubs.size()) * sizeof(uint32_t) / 1e6 << " MB of compressed hub labels, "
+                  << count_hubs * sizeof(HubLink) / 1e6 << " MB uncompressed" << std::endl;
     } else {
         std::cout << count_transfers << " transfers" << std::endl;
     }
 
     std::cout << connections.size() << " connections" << std::endl;
 
+    if (use_huge_pages) {
+        std::cout << huge_page_bytes() / (1 << 20) << " MB in huge pages" << std::endl;
+    }
+
     std::cout << std::string(80, '-') << std::endl;
 }
@@ -3,18 +3,23 @@
 
 #include <cstdint>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <set>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "config.hpp"
+#include "huge_pages.hpp"
 #include "utilities.hpp"
 
 using NodeID = uint32_t;
 using TripID = uint32_t;
 using Distance = uint32_t;
 using Time = uint32_t;
+using ConnectionID = uint32_t;
 
 // The constant 1e9 is chosen such that ∞ + ∞ does not overflow
 constexpr Time INF = static_cast<Time>(1e9);
@@ -51,42 +56,198 @@ struct HubLink {
 };
 
 
+// A hub label decoded from the compressed labels of a stop, see HubLabelView
+struct HubLabel {
+    NodeID hub_id;
+    Time time;
+};
+
+
+// The compressed hub labels of a stop, in the order of their walking times. The block of a stop starts with
+// the smallest hub id of its labels, then each label is a word with the offset of its hub id from this base
+// in the low 16 bits, and its walking time in the high 16 bits. When an offset or a walking time does not fit
+// in 16 bits, all the labels of the stop take two words instead, the offset and the walking time, which is
+// flagged by the top bit of the base. Both layouts are decoded with the same masks and shifts, without branches.
+class HubLabelView {
+private:
+    static const uint32_t wide_flag = 0x80000000;
+
+    struct Layout {
+        NodeID base;
+        uint32_t stride;
+        uint32_t mask;
+        uint32_t shift;
+    };
+
+    const uint32_t* _begin = nullptr;
+    const uint32_t* _end = nullptr;
+    Layout _layout {0, 1, 0xFFFF, 16};
+
+public:
+    class Iterator {
+    private:
+        const uint32_t* _word;
+        Layout _layout;
+
+    public:
+        Iterator(const uint32_t* word, const Layout& layout) : _word {word}, _layout (layout) {};
+
+        HubLabel operator*() const {
+            return {_layout.base + (_word[0] & _layout.mask), _word[_layout.stride - 1] >> _layout.shift};
+        }
+
+        Iterator& operator++() {
+            _word += _layout.stride;
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const { return _word != other._word; }
+    };
+
+    HubLabelView(const uint32_t* first, const uint32_t* last) {
+        if (first == last) return;
+
+        _begin = first + 1;
+        _end = last;
+
+        if ((*first & wide_flag) != 0) {
+            _layout = {*first & ~wide_flag, 2, 0xFFFFFFFF, 0};
+        } else {
+            _layout.base = *first;
+        }
+    }
+
+    Iterator begin() const { return {_begin, _layout}; }
+
+    Iterator end() const { return {_end, _layout}; }
+
+    std::size_t size() const { return static_cast<std::size_t>(_end - _begin) / _layout.stride; }
+
+    // Append the block of the given labels of a stop to the words, return whether it uses two words per label
+    static bool compress(const HubLink* first, const HubLink* last, std::vector<uint32_t>& words);
+};
+
+
+// A range of positions in one of the arrays of the timetable. Contrary to iterators, the offsets
+// stay valid when the arrays are copied, or mapped at another address by another process.
+struct Range {
+    uint64_t first;
+    uint64_t last;
+};
+
+
+template<class T>
+class ArrayView {
+private:
+    const T* _begin;
+    const T* _end;
+
+public:
+    ArrayView(const T* first, const T* last) : _begin {first}, _end {last} {};
+
+    const T* begin() const { return _begin; }
+
+    const T* end() const { return _end; }
+
+    std::size_t size() const { return static_cast<std::size_t>(_end - _begin); }
+};
+
+
+// A read-only array which either owns its elements, or refers to elements stored elsewhere,
+// e.g. in a shared memory mapping which must outlive the array. A copy always owns its elements.
 template<class T>
-class VectorView {
+class Array {
 public:
-    using Container = std::vector<T>;
-    using Iterator = typename Container::const_iterator;
+    using Storage = std::vector<T, HugePageAllocator<T>>;
 
 private:
-    Iterator _begin, _end;
+    Storage _owned;
+    const T* _borrowed = nullptr;
+    std::size_t _borrowed_size = 0;
 
 public:
-    VectorView() = default;
+    using value_type = T;
+    using const_iterator = const T*;
+    using const_reverse_iterator = std::reverse_iterator<const T*>;
+
+    Array() = default;
+
+    Array(const std::vector<T>& vec) : _owned(vec.begin(), vec.end()) {};
+
+    Array(const Array& other) : _owned(other.begin(), other.end()) {};
+
+    Array(Array&& other) = default;
+
+    Array& operator=(const Array& other) {
+        if (this != &other) {
+            _owned.assign(other.begin(), other.end());
+            _borrowed = nullptr;
+            _borrowed_size = 0;
+        }
+        return *this;
+    }
+
+    Array& operator=(Array&& other) = default;
+
+    static Array borrow(const T* data, std::size_t size) {
+        Array array;
+        array._borrowed = data;
+        array._borrowed_size = size;
+        return array;
+    }
+
+    bool is_borrowed() const { return _borrowed != nullptr; }
+
+    // The elements can only be modified in an owned array, a borrowed array is copied first
+    Storage& vector() {
+        if (_borrowed != nullptr) {
+            _owned.assign(_borrowed, _borrowed + _borrowed_size);
+            _borrowed = nullptr;
+            _borrowed_size = 0;
+        }
+        return _owned;
+    }
+
+    const T* data() const { return _borrowed != nullptr ? _borrowed : _owned.data(); }
+
+    std::size_t size() const { return _borrowed != nullptr ? _borrowed_size : _owned.size(); }
+
+    bool empty() const { return size() == 0; }
+
+    const T* begin() const { return data(); }
+
+    const T* end() const { return data() + size(); }
 
-    VectorView(const Container& vec, size_t first_idx, size_t last_idx) :
-            _begin {vec.begin() + first_idx}, _end {vec.begin() + last_idx} {};
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
 
-    Iterator begin() const { return _begin; }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
 
-    Iterator end() const { return _end; }
+    const T& operator[](std::size_t i) const { return data()[i]; }
+
+    const T& front() const { return data()[0]; }
+
+    const T& back() const { return data()[size() - 1]; }
+
+    ArrayView<T> view(const Range& range) const { return {data() + range.first, data() + range.last}; }
 };
 
 
+// The footpaths of a stop are given by ranges in the arrays of the timetable, see Timetable::transfers
 struct Stop {
     NodeID id;
-    VectorView<Transfer> transfers;
-    VectorView<Transfer> backward_transfers;
-    VectorView<HubLink> in_hubs;
-    VectorView<HubLink> out_hubs;
-
-    explicit Stop(NodeID sid) : id {sid} {};
+    Range transfers;
+    Range backward_transfers;
+    Range in_hubs;
+    Range out_hubs;
+    Range departures;
+
+    explicit Stop(NodeID sid) :
+            id {sid}, transfers {}, backward_transfers {}, in_hubs {}, out_hubs {}, departures {} {};
 };
 
 
+// The connections are trivially copyable, so that they can be stored in a binary snapshot
 class Connection {
-private:
-    std::tuple<Time, Time, TripID, int> _tuple;
-
 public:
     TripID trip_id;
     NodeID departure_stop_id, arrival_stop_id;
@@ -95,49 +256,190 @@ public:
 
     Connection(TripID tid, NodeID dsid, NodeID asid, Time dt, Time at, int seq) :
             trip_id {tid}, departure_stop_id {dsid}, arrival_stop_id {asid},
-            departure_time {dt}, arrival_time {at}, stop_sequence {seq} {
-        _tuple = {departure_time, arrival_time, trip_id, stop_sequence};
-    };
+            departure_time {dt}, arrival_time {at}, stop_sequence {seq} {};
 
+    // The connections are ordered lexicographically by departure time, arrival time, trip id,
+    // and the order of the connection in the trip
     friend bool operator<(const Connection& conn1, const Connection& conn2) {
-        return conn1._tuple < conn2._tuple;
+        return std::tie(conn1.departure_time, conn1.arrival_time, conn1.trip_id, conn1.stop_sequence) <
+               std::tie(conn2.departure_time, conn2.arrival_time, conn2.trip_id, conn2.stop_sequence);
     }
 
     friend bool operator==(const Connection& conn1, const Connection& conn2) {
-        return conn1._tuple == conn2._tuple;
+        return std::tie(conn1.departure_time, conn1.arrival_time, conn1.trip_id, conn1.stop_sequence) ==
+               std::tie(conn2.departure_time, conn2.arrival_time, conn2.trip_id, conn2.stop_sequence);
     }
+
+    // The order of the arrival index, lexicographically by arrival time, departure time, trip id,
+    // and the order of the connection in the trip
+    friend bool arrives_before(const Connection& conn1, const Connection& conn2) {
+        return std::tie(conn1.arrival_time, conn1.departure_time, conn1.trip_id, conn1.stop_sequence) <
+               std::tie(conn2.arrival_time, conn2.departure_time, conn2.trip_id, conn2.stop_sequence);
+    }
+};
+
+
+// The raw content of a timetable, either parsed from the dataset files
+// or built directly in memory (e.g. by the synthetic generator)
+struct TimetableData {
+    std::size_t n_stops = 0;
+    std::vector<Transfer> transfers;
+    std::vector<HubLink> in_hubs;
+    std::vector<HubLink> out_hubs;
+    std::unordered_map<TripID, Events> trip_events;
 };
 
 
+class SnapshotFile;
+
+
 class Timetable {
 private:
-    VectorView<Transfer>::Container _transfers;
-    VectorView<Transfer>::Container _backward_transfers;
-    VectorView<HubLink>::Container _in_hubs;
-    VectorView<HubLink>::Container _out_hubs;
+    Array<Transfer> _transfers;
+    Array<Transfer> _backward_transfers;
+    Array<uint32_t> _in_hubs;
+    Array<uint32_t> _out_hubs;
+
+    // The connections departing from each stop, in the order of their departure times
+    Array<ConnectionID> _departures;
+
+    // The connections of each trip in the order of the trip, the connections of the trip t
+    // are between the offsets _trip_offsets[t] and _trip_offsets[t + 1]
+    Array<ConnectionID> _trip_connections;
+    Array<ConnectionID> _trip_offsets;
+
+    // The mapping of the binary snapshot the arrays refer to, if the timetable was loaded from one
+    std::shared_ptr<const SnapshotFile> _snapshot;
+
+    // The timetable the arrays are shared with, if this one was made by Timetable(base)
+    std::shared_ptr<const Timetable> _root;
 
     void parse_data();
 
-    void parse_stops();
+    void parse_stops(TimetableData& data);
+
+    void parse_transfers(TimetableData& data);
+
+    void parse_hubs(TimetableData& data);
+
+    void parse_connections(TimetableData& data);
+
+    void build(TimetableData& data);
 
-    void parse_transfers();
+    void build_stops(const TimetableData& data);
 
-    void parse_hubs();
+    void build_transfers(TimetableData& data);
 
-    void parse_connections();
+    void build_hubs(TimetableData& data);
+
+    void compact_hub_ids(std::vector<HubLink>& in_hubs, std::vector<HubLink>& out_hubs);
+
+    void build_connections(const TimetableData& data);
+
+    void prune_connections();
+
+    void renumber_stops(TimetableData& data);
+
+    void renumber_trips();
 
 public:
     std::string path;
-    std::vector<Connection> connections;
-    std::vector<Stop> stops;
+    Array<Connection> connections;
+    Array<Stop> stops;
+
+    // The indices of the connections in the order of their arrival times, see index_connections
+    Array<ConnectionID> arrival_order;
     std::size_t max_node_id = 0;
     std::size_t max_trip_id = 0;
 
+    // The original id of each stop and trip, and the inverse mapping of the stops,
+    // only filled if the ids are renumbered. The ids used in the input and the output
+    // of the experiments are the original ones.
+    Array<NodeID> original_stop_ids;
+    Array<NodeID> internal_stop_ids;
+    Array<TripID> original_trip_ids;
+    Array<TripID> internal_trip_ids;
+
+    // The original id of each road node used as a hub, the node with the original id
+    // original_hub_ids[i] has the id stops.size() + i
+    Array<NodeID> original_hub_ids;
+
     Timetable() {
         path = "../../Public-Transit-Data/" + name + "/";
         parse_data();
     }
 
+    explicit Timetable(TimetableData data) {
+        build(data);
+    }
+
+    // Load the timetable from a binary snapshot, the arrays refer to the mapping of the file
+    // instead of being copied, so that all the processes mapping the same file share the memory
+    explicit Timetable(std::shared_ptr<const SnapshotFile> snapshot);
+
+    // A copy owns all its arrays, even if the original timetable was loaded from a snapshot
+    Timetable(const Timetable& other) = default;
+
+    // A timetable sharing the arrays of the base one, whose arrays are only copied once they are modified,
+    // e.g. by retime_connections. The arrays of the base which are not shared with its own root are copied
+    // right away, so that a chain of such timetables only keeps the first one alive.
+    explicit Timetable(const std::shared_ptr<const Timetable>& base);
+
+    Timetable& operator=(const Timetable&) = delete;
+
+    ArrayView<Transfer> transfers(const NodeID& stop_id) const {
+        return _transfers.view(stops[stop_id].transfers);
+    }
+
+    ArrayView<Transfer> backward_transfers(const NodeID& stop_id) const {
+        return _backward_transfers.view(stops[stop_id].backward_transfers);
+    }
+
+    HubLabelView in_hubs(const NodeID& stop_id) const {
+        return {_in_hubs.data() + stops[stop_id].in_hubs.first, _in_hubs.data() + stops[stop_id].in_hubs.last};
+    }
+
+    HubLabelView out_hubs(const NodeID& stop_id) const {
+        return {_out_hubs.data() + stops[stop_id].out_hubs.first, _out_hubs.data() + stops[stop_id].out_hubs.last};
+    }
+
+    // The connections departing from the stop, in the order of their departure times
+    ArrayView<ConnectionID> departures(const NodeID& stop_id) const {
+        return _departures.view(stops[stop_id].departures);
+    }
+
+    // The next connections departing from the stop not before the given time, at most max_count of them
+    ArrayView<ConnectionID> next_departures(const NodeID& stop_id, const Time& time, const std::size_t& max_count) const;
+
+    // The connections departing from the stop in the window [first_time, last_time)
+    ArrayView<ConnectionID> departures_between(const NodeID& stop_id, const Time& first_time,
+                                               const Time& last_time) const;
+
+    // The connections of the trip from the given stop sequence on, in the order of the trip
+    ArrayView<ConnectionID> trip_connections(const TripID& trip_id, const int& from_stop_sequence = 0) const;
+
+    // Whether walking two footpaths in a row is never faster than a single footpath, which the connection scan
+    // assumes since it only walks one footpath after each connection
+    bool transfers_closed() const;
+
+    // Build the indexes derived from the connection array, must be called again after modifying it
+    void index_connections();
+
+    // Replace the times of the connections with the same trip and stop sequence as the given ones, and update
+    // the order of the connection array and its indexes around the retimed connections only
+    void retime_connections(const std::vector<Connection>& retimed);
+
+    // Write the timetable to a binary snapshot, which can be mapped by Timetable(snapshot)
+    void save(const std::string& file_path) const;
+
+    NodeID internal_stop_id(const NodeID& original_id) const {
+        return internal_stop_ids.empty() ? original_id : internal_stop_ids[original_id];
+    }
+
+    TripID internal_trip_id(const TripID& original_id) const {
+        return internal_trip_ids.empty() ? original_id : internal_trip_ids[original_id];
+    }
+
     void summary() const;
 };
 
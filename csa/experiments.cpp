@@ -1,16 +1,36 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iomanip>
+#include <memory>
 #include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 #include "config.hpp"
 #include "experiments.hpp"
 #include "csa.hpp"
+#include "csa_accel.hpp"
 #include "csv.h"
+#include "lower_bounds.hpp"
+#include "narrow_times.hpp"
+#include "numa.hpp"
+#include "query_cache.hpp"
+#include "raptor.hpp"
+#include "scan_kernels.hpp"
+#include "transfer_patterns.hpp"
+#include "trip_based.hpp"
 
 
 void write_results(const Results& results) {
-    std::string profile_prefix = profile ? "p" : "";
+    std::string profile_prefix = profile ? "p" : latest ? "ld" : "";
     std::string hub_prefix = use_hl ? "HL" : "";
-    std::string algo_str = profile_prefix + hub_prefix + "CSA";
+    std::string algo_name = algorithm == "raptor" ? "RAPTOR" : algorithm == "tb" ? "TB" :
+                            algorithm == "csaccel" ? "CSAccel" : algorithm == "tp" ? "TP" : "CSA";
+    std::string kernel_prefix = narrow ? "narrow" : kernel != "scalar" ? kernel : "";
+    std::string algo_str = board > 0 ? "board" : profile_prefix + hub_prefix + kernel_prefix + algo_name;
 
     std::ofstream stats_file {"../" + name + '_' + algo_str + "_stats.csv"};
 
@@ -18,6 +38,10 @@ void write_results(const Results& results) {
 
     if (profile) {
         stats_file << ",n_journey\n";
+    } else if (board > 0) {
+        stats_file << ",n_departures\n";
+    } else if (latest) {
+        stats_file << ",departure_time\n";
     } else {
         stats_file << ",arrival_time\n";
     }
@@ -30,7 +54,7 @@ void write_results(const Results& results) {
         stats_file << result.running_time;
         total_running_time += result.running_time;
 
-        if (profile) {
+        if (profile || board > 0) {
             stats_file << ',' << result.n_journey << '\n';
         } else {
             stats_file << ',' << result.arrival_time << '\n';
@@ -45,7 +69,7 @@ Queries Experiment::read_queries() {
     Queries queries;
     std::string rank_str = ranked ? "rank_" : "";
 
-    std::ifstream queries_file_stream {_timetable.path + rank_str + "queries.csv"};
+    std::ifstream queries_file_stream {_store.acquire()->path + rank_str + "queries.csv"};
     io::CSVReader<4> queries_file_reader {"queries.csv", queries_file_stream};
     queries_file_reader.read_header(io::ignore_no_column, "rank", "source", "target", "time");
 
@@ -61,36 +85,414 @@ Queries Experiment::read_queries() {
 }
 
 
-void Experiment::run() const {
+// The order in which the queries are run. Sorting them by departure time makes consecutive queries
+// start their scans close to each other in the connection array, so that the scanned window stays
+// in the cache. Grouping them by the region of the source first also reuses the states of the stops
+// around the sources, the regions being ranges of the stop ids, which follow the connections
+// with --renumber.
+std::vector<std::size_t> Experiment::schedule_queries() const {
+    std::vector<std::size_t> order(_queries.size());
+
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+
+    if (schedule.empty()) return order;
+
+    auto timetable = _store.acquire();
+    std::size_t region_size = std::max<std::size_t>(timetable->stops.size() / n_source_regions, 1);
+
+    auto region = [&](const Query& query) {
+        return schedule == "region" ? timetable->internal_stop_id(query.source_id) / region_size : 0;
+    };
+
+    std::stable_sort(order.begin(), order.end(), [&](const std::size_t& i, const std::size_t& j) {
+        return std::make_pair(region(_queries[i]), _queries[i].dep) <
+               std::make_pair(region(_queries[j]), _queries[j].dep);
+    });
+
+    return order;
+}
+
+
+// The stops within the --nearby walking time of a stop, with their walking times from the stop,
+// or to the stop for the backward transfers, simulating a query between geographic points
+static std::vector<StopOffset> nearby_stops(const Timetable& timetable, const NodeID& stop_id, const bool& backward) {
+    std::vector<StopOffset> stops {{stop_id, 0}};
+
+    for (const auto& transfer: backward ? timetable.backward_transfers(stop_id) : timetable.transfers(stop_id)) {
+        const auto& other_id = backward ? transfer.source_id : transfer.target_id;
+
+        if (other_id != stop_id && transfer.time <= nearby) {
+            stops.push_back({other_id, transfer.time});
+        }
+    }
+
+    return stops;
+}
+
+
+// The preprocessed data of an algorithm, built from a snapshot of the timetable and shared by the workers.
+// It is rebuilt when the workers move to a new generation of the store, before the timer of their next query
+// starts. The replicas of a snapshot on the NUMA nodes share the index built from the first of them.
+template<class Index>
+class SnapshotIndex {
+private:
+    std::mutex _mutex;
+    std::shared_ptr<const Index> _index;
+    uint64_t _generation = 0;
+
+public:
+    std::shared_ptr<const Index> get(const std::shared_ptr<const Timetable>& snapshot, const uint64_t& generation) {
+        std::lock_guard<std::mutex> lock {_mutex};
+
+        if (!_index || _generation != generation) {
+            Timer timer;
+            _index = std::make_shared<const Index>(snapshot);
+            _generation = generation;
+            std::cout << "Preprocessing done in " << timer.elapsed() << timer.unit() << std::endl;
+        }
+
+        return _index;
+    }
+};
+
+
+// The groups of queries which are run together. With --all-to-one, the queries to the same target form
+// a group answered by a single backward scan, the groups being in the order of their first query.
+// Otherwise each query is a group on its own.
+std::vector<std::vector<std::size_t>> Experiment::group_queries(const std::vector<std::size_t>& order) const {
+    std::vector<std::vector<std::size_t>> groups;
+    std::unordered_map<NodeID, std::size_t> target_groups;
+
+    for (const auto& i: order) {
+        if (!all_to_one) {
+            groups.push_back({i});
+            continue;
+        }
+
+        auto inserted = target_groups.emplace(_queries[i].target_id, groups.size());
+
+        if (inserted.second) {
+            groups.emplace_back();
+        }
+
+        groups[inserted.first->second].push_back(i);
+    }
+
+    return groups;
+}
+
+
+void Experiment::run() {
     Results res;
-    ConnectionScan csa {&_timetable};
-    Time arrival_time {INF};
-    ProfilePareto prof;
-    std::size_t n_journey {0};
+    std::future<void> reloading;
+    std::size_t n_reload {0};
+
+    // Without a schedule, the groups of queries are handed out one at a time to the workers. With a schedule,
+    // each worker runs a contiguous band of the order, e.g. a range of departure times.
+    // The mutex guards the reloads and the output.
+    std::vector<std::vector<std::size_t>> order = group_queries(schedule_queries());
+    std::atomic<std::size_t> next_position {0};
+    std::mutex mutex;
+
+    std::size_t n_workers = std::max<std::size_t>(n_threads, 1);
+    std::unique_ptr<QueryCache> cache;
+
+    // A profile only answers the queries of the connection scan when the footpaths are transitively closed.
+    // The hub labels are taken to give the shortest walking times, under which two walks are never faster than one.
+    if (cache_size > 0 && profile_cache && !use_hl && !_store.acquire()->transfers_closed()) {
+        std::cerr << "Error occurred while setting up the cache: --profile-cache needs transitively closed footpaths"
+                  << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        exit(1);
+    }
+
+    if (cache_size > 0) {
+        cache.reset(new QueryCache {cache_size, static_cast<Time>(cache_bucket), profile_cache});
+    }
+
+    std::unique_ptr<LowerBoundCache> lower_bounds;
+
+    if (lower_bound_targets > 0) {
+        lower_bounds.reset(new LowerBoundCache {lower_bound_targets});
+    }
+
+    SnapshotIndex<RaptorTimetable> raptor_routes;
+    SnapshotIndex<TripBasedTimetable> trip_transfers;
+    SnapshotIndex<AcceleratedTimetable> accel_cells;
+    SnapshotIndex<TransferPatterns> transfer_patterns;
+    SnapshotIndex<StopGraph> stop_graphs;
+    SnapshotIndex<ConnectionColumns> connection_columns;
+    SnapshotIndex<NarrowTimetable> narrow_timetables;
+    std::atomic<std::size_t> n_out_of_range {0};
+
+    auto nodes = numa_nodes();
+
+    // On a machine with several NUMA nodes, each worker reads the replica on its own node
+    if (n_workers > 1 && nodes.size() > 1) {
+        _store.replicate(nodes);
+        std::cout << "Timetable replicated on " << nodes.size() << " NUMA nodes" << std::endl;
+    }
+
+    auto worker = [&](const std::size_t& worker_id) {
+        std::size_t node = worker_id % nodes.size();
+
+        if (n_workers > 1) {
+            pin_thread(nodes[node]);
+        }
+
+        ConnectionScan csa {&_store, node};
+        std::unique_ptr<Raptor> raptor;
+        std::unique_ptr<TripBased> trip_based;
+        std::unique_ptr<AcceleratedScan> accel;
+        std::unique_ptr<TransferPatternQuery> pattern_query;
+        std::unique_ptr<KernelScan> kernel_scan;
+        std::unique_ptr<NarrowScan> narrow_scan;
+        std::shared_ptr<const StopGraph> stop_graph;
+        Time arrival_time {INF};
+        ProfilePareto prof;
+        std::size_t n_journey {0};
+
+        std::size_t position = schedule.empty() ? next_position++ : order.size() * worker_id / n_workers;
+        std::size_t band_end = schedule.empty() ? order.size() : order.size() * (worker_id + 1) / n_workers;
+
+        for (; position < band_end; position = schedule.empty() ? next_position++ : position + 1) {
+            // The results are stored at the indices of the queries in the file, which restores the original order
+            const auto& group = order[position];
+
+            // Start reloading the timetable in the background, unless the previous reload is still running
+            if (reload_interval > 0 && position > 0 && position % reload_interval == 0) {
+                std::lock_guard<std::mutex> lock {mutex};
+
+                if (!reloading.valid() || reloading.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    if (reloading.valid()) reloading.get();
+
+                    reloading = _store.reload();
+                    ++n_reload;
+                }
+            }
+
+            csa.init();
+
+            if (algorithm == "raptor") {
+                auto routes = raptor_routes.get(csa.snapshot(), csa.generation());
+
+                if (!raptor || raptor->routes() != routes) {
+                    raptor.reset(new Raptor {routes});
+                }
+            } else if (algorithm == "tb") {
+                auto trips = trip_transfers.get(csa.snapshot(), csa.generation());
+
+                if (!trip_based || trip_based->trips() != trips) {
+                    trip_based.reset(new TripBased {trips});
+                }
+            } else if (algorithm == "csaccel") {
+                auto partition = accel_cells.get(csa.snapshot(), csa.generation());
+
+                if (!accel || accel->cells() != partition) {
+                    accel.reset(new AcceleratedScan {partition});
+                }
+            } else if (algorithm == "tp") {
+                auto patterns = transfer_patterns.get(csa.snapshot(), csa.generation());
+
+                if (!pattern_query || pattern_query->patterns() != patterns) {
+                    pattern_query.reset(new TransferPatternQuery {patterns});
+                }
+            }
+
+            if (kernel != "scalar") {
+                auto columns = connection_columns.get(csa.snapshot(), csa.generation());
+
+                if (!kernel_scan || kernel_scan->columns() != columns) {
+                    kernel_scan.reset(new KernelScan {columns, prefetch_distance});
+                }
+            }
+
+            if (narrow) {
+                auto narrow_timetable = narrow_timetables.get(csa.snapshot(), csa.generation());
+
+                if (!narrow_scan || narrow_scan->timetable() != narrow_timetable) {
+                    narrow_scan.reset(new NarrowScan {narrow_timetable});
+                }
+            }
+
+            if (lower_bounds) {
+                stop_graph = stop_graphs.get(csa.snapshot(), csa.generation());
+            }
+
+            // The ids of the queries are translated with the snapshot used by the query,
+            // since a reloaded timetable might be numbered differently
+            auto internal_query = [&](const std::size_t& i) {
+                auto query = _queries[i];
+                query.source_id = csa.timetable().internal_stop_id(query.source_id);
+                query.target_id = csa.timetable().internal_stop_id(query.target_id);
+                return query;
+            };
+
+            if (all_to_one) {
+                Timer timer;
+                csa.all_to_one_profile(internal_query(group.front()).target_id);
+
+                std::vector<std::size_t> n_journeys;
+
+                for (const auto& i: group) {
+                    n_journeys.push_back(csa.source_profile(internal_query(i).source_id).size());
+                }
+
+                // The running time of the backward scan is shared by the queries of the group
+                double running_time = timer.elapsed() / group.size();
+
+                for (std::size_t k = 0; k < group.size(); ++k) {
+                    auto query = internal_query(group[k]);
+                    res[group[k]] = {query.rank, running_time, arrival_time, n_journeys[k]};
+                }
+            } else {
+                std::size_t i = group.front();
+                auto query = internal_query(i);
+
+                Timer timer;
+
+                if (board > 0) {
+                    // The departure board of the source from the time of the query
+                    n_journey = csa.timetable().next_departures(query.source_id, query.dep, board).size();
+                } else if (latest) {
+                    // The time of the query is the arrival time, the result is stored in the arrival time column
+                    arrival_time = csa.latest_departure_query(query.source_id, query.target_id, query.dep);
+                } else if (!profile && nearby > 0) {
+                    arrival_time = csa.query(nearby_stops(csa.timetable(), query.source_id, false),
+                                             nearby_stops(csa.timetable(), query.target_id, true), query.dep);
+                } else if (raptor) {
+                    arrival_time = raptor->query(query.source_id, query.target_id, query.dep);
+                } else if (accel) {
+                    arrival_time = accel->query(query.source_id, query.target_id, query.dep);
+                } else if (pattern_query) {
+                    arrival_time = pattern_query->query(query.source_id, query.target_id, query.dep);
+                } else if (kernel_scan) {
+                    arrival_time = kernel_scan->query(query.source_id, query.target_id, query.dep);
+                } else if (narrow_scan) {
+                    arrival_time = narrow_scan->query(query.source_id, query.target_id, query.dep);
+
+                    // The journeys arriving too late for the narrow times are searched by the basic scan
+                    if (narrow_scan->out_of_range()) {
+                        arrival_time = csa.query(query.source_id, query.target_id, query.dep);
+                        ++n_out_of_range;
+                    }
+                } else if (trip_based && !profile) {
+                    arrival_time = trip_based->query(query.source_id, query.target_id, query.dep);
+                } else if (trip_based) {
+                    prof = trip_based->profile_query(query.source_id, query.target_id);
+                    n_journey = prof.size();
+                } else if (lower_bounds) {
+                    auto bounds = lower_bounds->get(*stop_graph, csa.generation(), query.target_id);
+                    arrival_time = csa.query(query.source_id, query.target_id, query.dep, true, bounds.get());
+                } else if (!profile) {
+                    arrival_time = cache ? cache->query(csa, query.source_id, query.target_id, query.dep) :
+                                   csa.query(query.source_id, query.target_id, query.dep);
+                } else {
+                    prof = cache ? cache->profile_query(csa, query.source_id, query.target_id) :
+                           csa.profile_query(query.source_id, query.target_id);
+                    n_journey = prof.size();
+                }
+
+                double running_time = timer.elapsed();
+
+                res[i] = {query.rank, running_time, arrival_time, n_journey};
+            }
+
+            csa.clear();
+
+            std::lock_guard<std::mutex> lock {mutex};
+            for (const auto& i: group) {
+                std::cout << i << std::endl;
+            }
+        }
+    };
 
     res.resize(_queries.size());
-    for (size_t i = 0; i < _queries.size(); ++i) {
-        auto query = _queries[i];
-        csa.init();
+    Timer batch_timer;
 
-        Timer timer;
+    if (n_workers == 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> threads;
 
-        if (!profile) {
-            arrival_time = csa.query(query.source_id, query.target_id, query.dep);
-        } else {
-            prof = csa.profile_query(query.source_id, query.target_id);
-            n_journey = prof.size();
+        for (std::size_t worker_id = 0; worker_id < n_workers; ++worker_id) {
+            threads.emplace_back(worker, worker_id);
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
         }
+    }
+
+    std::cout << "Time elapsed: " << batch_timer.elapsed() << batch_timer.unit() << std::endl;
+
+    if (reloading.valid()) reloading.get();
 
-        double running_time = timer.elapsed();
+    if (cache) {
+        cache->report();
+    }
+
+    if (lower_bounds) {
+        lower_bounds->report();
+    }
 
-        res[i] = {query.rank, running_time, arrival_time, n_journey};
-        csa.clear();
+    if (narrow) {
+        std::cout << "Queries out of the range of the narrow times: " << n_out_of_range << std::endl;
+    }
 
-        std::cout << i << std::endl;
+    if (reload_interval > 0) {
+        std::cout << "Timetable reloaded " << n_reload << " times" << std::endl;
     }
 
     write_results(res);
 
     Profiler::report();
 }
+
+
+// The queries are run in the order of the file on a single thread, after a first run to warm up the caches
+void Experiment::sweep_prefetch() {
+    static const std::size_t distances[] = {0, 1, 2, 4, 8, 16, 32, 64, 128, 256};
+
+    auto timetable = _store.acquire();
+    auto columns = std::make_shared<const ConnectionColumns>(timetable);
+
+    Queries queries;
+
+    for (auto query: _queries) {
+        query.source_id = timetable->internal_stop_id(query.source_id);
+        query.target_id = timetable->internal_stop_id(query.target_id);
+        queries.push_back(query);
+    }
+
+    auto run_queries = [&](const std::size_t& distance) {
+        KernelScan kernel_scan {columns, distance};
+        Timer timer;
+
+        for (const auto& query: queries) {
+            kernel_scan.query(query.source_id, query.target_id, query.dep);
+        }
+
+        return timer.elapsed() / queries.size();
+    };
+
+    run_queries(prefetch_distance);
+
+    std::size_t best_distance {0};
+    double best_time {0};
+
+    for (const auto& distance: distances) {
+        double running_time = run_queries(distance);
+
+        std::cout << "Prefetch distance " << distance << ": " << running_time << Timer().unit() << std::endl;
+
+        if (distance == distances[0] || running_time < best_time) {
+            best_distance = distance;
+            best_time = running_time;
+        }
+    }
+
+    std::cout << "Best prefetch distance: " << best_distance << std::endl;
+}
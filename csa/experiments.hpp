@@ -4,7 +4,10 @@
 #include <utility> // std::move
 #include <vector>
 
+#include "config.hpp"
 #include "data_structure.hpp"
+#include "snapshot.hpp"
+#include "timetable_store.hpp"
 
 
 struct Query {
@@ -39,17 +42,29 @@ using Results = std::vector<Result>;
 
 class Experiment {
 private:
-    const Timetable _timetable;
+    TimetableStore _store;
     const Queries _queries;
 
+    // The number of ranges of stop ids used to group the queries by source
+    static const std::size_t n_source_regions = 64;
+
     Queries read_queries();
 
+    std::vector<std::size_t> schedule_queries() const;
+
+    std::vector<std::vector<std::size_t>> group_queries(const std::vector<std::size_t>& order) const;
+
 public:
-    Experiment() : _timetable {}, _queries {read_queries()} {
-        _timetable.summary();
+    Experiment() : _store {snapshot_path.empty() ? std::make_shared<const Timetable>() :
+                           load_shared_timetable(snapshot_path)},
+                   _queries {read_queries()} {
+        _store.acquire()->summary();
     }
 
-    void run() const;
+    void run();
+
+    // Run the earliest arrival queries with the prefetch kernel once for each prefetch distance
+    void sweep_prefetch();
 };
 
 #endif // EXPERIMENTS_HPP
@@ -0,0 +1,578 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sys/stat.h>
+#include <unordered_map>
+
+#include "generator.hpp"
+#include "gzstream.h"
+
+
+// A bucket grid over the plane to find all the points within a given radius of a point
+class SpatialIndex {
+private:
+    using Cell = std::pair<int64_t, int64_t>;
+
+    double _cell_size;
+    std::unordered_map<std::tuple<int64_t, int64_t>, std::vector<NodeID>> _cells;
+
+    Cell cell_of(double x, double y) const {
+        return {static_cast<int64_t>(std::floor(x / _cell_size)), static_cast<int64_t>(std::floor(y / _cell_size))};
+    }
+
+public:
+    SpatialIndex(const std::vector<double>& xs, const std::vector<double>& ys, double cell_size) :
+            _cell_size {cell_size} {
+        for (size_t i = 0; i < xs.size(); ++i) {
+            auto cell = cell_of(xs[i], ys[i]);
+            _cells[std::make_tuple(cell.first, cell.second)].push_back(static_cast<NodeID>(i));
+        }
+    }
+
+    // Call f on every point in the cells intersecting the square of side 2 * radius around (x, y)
+    template<class F>
+    void for_each_near(double x, double y, double radius, F f) const {
+        auto low = cell_of(x - radius, y - radius);
+        auto high = cell_of(x + radius, y + radius);
+
+        for (int64_t cx = low.first; cx <= high.first; ++cx) {
+            for (int64_t cy = low.second; cy <= high.second; ++cy) {
+                auto iter = _cells.find(std::make_tuple(cx, cy));
+
+                if (iter == _cells.end()) continue;
+
+                for (const auto& id: iter->second) {
+                    f(id);
+                }
+            }
+        }
+    }
+};
+
+
+// Create the directory and all its missing parents, similar to mkdir -p
+static void make_directories(const std::string& path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        std::string prefix = path.substr(0, pos);
+
+        if (!prefix.empty() && mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "Error occurred while creating " << prefix << std::endl;
+            std::cerr << "Exiting..." << std::endl;
+            exit(1);
+        }
+
+        if (pos == std::string::npos) break;
+    }
+}
+
+
+TimetableGenerator::TimetableGenerator(const GeneratorParams& params) : _params {params} {
+    switch (_params.kind) {
+        case NetworkKind::Grid:
+            generate_grid();
+            break;
+        case NetworkKind::Radial:
+            generate_radial();
+            break;
+        case NetworkKind::Country:
+            generate_country();
+            break;
+        case NetworkKind::Cities:
+            generate_cities();
+            break;
+    }
+
+    make_footpaths();
+}
+
+
+void TimetableGenerator::generate_grid() {
+    std::mt19937 rng {_params.seed};
+
+    add_grid(_params.n_stops, {0, 0}, rng);
+}
+
+
+// Add a square grid of the given number of stops, from the given corner on, with a bus line along every row
+// and every column served in both directions
+void TimetableGenerator::add_grid(const std::size_t& n_stops, const Point& corner, std::mt19937& rng) {
+    std::uniform_int_distribution<Time> headway_dist {_params.min_headway, _params.max_headway};
+
+    auto first = static_cast<NodeID>(_positions.size());
+    auto n_cols = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(n_stops))));
+    auto n_rows = (n_stops + n_cols - 1) / n_cols;
+
+    for (std::size_t i = 0; i < n_stops; ++i) {
+        _positions.push_back({corner.x + (i % n_cols) * _params.stop_spacing,
+                              corner.y + (i / n_cols) * _params.stop_spacing});
+    }
+
+    auto add_line = [&](std::vector<NodeID> line) {
+        if (line.size() < 2) return;
+
+        // Every line is served in both directions
+        for (int direction = 0; direction < 2; ++direction) {
+            Time headway = headway_dist(rng);
+            add_route(line, headway, _params.service_start, 0);
+            std::reverse(line.begin(), line.end());
+        }
+    };
+
+    for (std::size_t row = 0; row < n_rows; ++row) {
+        std::vector<NodeID> line;
+        for (std::size_t col = 0; col < n_cols && row * n_cols + col < n_stops; ++col) {
+            line.push_back(static_cast<NodeID>(first + row * n_cols + col));
+        }
+        add_line(line);
+    }
+
+    for (std::size_t col = 0; col < n_cols; ++col) {
+        std::vector<NodeID> line;
+        for (std::size_t row = 0; row < n_rows && row * n_cols + col < n_stops; ++row) {
+            line.push_back(static_cast<NodeID>(first + row * n_cols + col));
+        }
+        add_line(line);
+    }
+}
+
+
+void TimetableGenerator::generate_radial() {
+    std::mt19937 rng {_params.seed};
+    std::uniform_int_distribution<Time> headway_dist {_params.min_headway, _params.max_headway};
+
+    std::size_t n_spokes = _params.n_lines > 0 ? _params.n_lines : 8;
+    std::size_t stops_per_spoke = std::max<std::size_t>(1, (_params.n_stops - 1) / n_spokes);
+    const double pi = std::acos(-1.0);
+
+    // The centre is stop 0, followed by the stops of each spoke from the inside out
+    _positions.push_back({0, 0});
+
+    for (std::size_t spoke = 0; spoke < n_spokes; ++spoke) {
+        double angle = 2 * pi * spoke / n_spokes;
+
+        for (std::size_t j = 1; j <= stops_per_spoke; ++j) {
+            _positions.push_back({j * _params.stop_spacing * std::cos(angle), j * _params.stop_spacing * std::sin(angle)});
+        }
+    }
+
+    auto spoke_stops = [&](std::size_t spoke) {
+        std::vector<NodeID> stops;
+        for (std::size_t j = 1; j <= stops_per_spoke; ++j) {
+            stops.push_back(static_cast<NodeID>(1 + spoke * stops_per_spoke + j - 1));
+        }
+        return stops;
+    };
+
+    // Each line runs from the end of a spoke through the centre to the end of the opposite spoke,
+    // with an odd number of spokes the one left over ends at the centre
+    for (std::size_t spoke = 0; spoke < (n_spokes + 1) / 2; ++spoke) {
+        auto line = spoke_stops(spoke);
+        std::reverse(line.begin(), line.end());
+        line.push_back(0);
+
+        if (spoke < n_spokes / 2) {
+            auto opposite = spoke_stops(spoke + (n_spokes + 1) / 2);
+            line.insert(line.end(), opposite.begin(), opposite.end());
+        }
+
+        for (int direction = 0; direction < 2; ++direction) {
+            add_route(line, headway_dist(rng), _params.service_start, 0);
+            std::reverse(line.begin(), line.end());
+        }
+    }
+}
+
+
+void TimetableGenerator::generate_country() {
+    std::mt19937 rng {_params.seed};
+    std::uniform_int_distribution<Time> headway_dist {_params.min_headway, _params.max_headway};
+    std::uniform_real_distribution<double> unit {0, 1};
+    std::normal_distribution<double> drift {0, 0.2};
+    std::uniform_int_distribution<std::size_t> length_dist {10, 40};
+
+    double side = _params.stop_spacing * std::sqrt(static_cast<double>(_params.n_stops));
+    const double pi = std::acos(-1.0);
+
+    std::vector<double> xs, ys;
+    for (std::size_t i = 0; i < _params.n_stops; ++i) {
+        _positions.push_back({unit(rng) * side, unit(rng) * side});
+        xs.push_back(_positions.back().x);
+        ys.push_back(_positions.back().y);
+    }
+
+    double search_radius = 3 * _params.stop_spacing;
+    SpatialIndex index {xs, ys, search_radius};
+
+    std::size_t n_routes = _params.n_lines > 0 ? _params.n_lines : std::max<std::size_t>(1, _params.n_stops / 5);
+    std::uniform_int_distribution<NodeID> stop_dist {0, static_cast<NodeID>(_params.n_stops - 1)};
+
+    for (std::size_t r = 0; r < n_routes; ++r) {
+        // Grow the route greedily in a slowly drifting direction
+        std::vector<NodeID> route {stop_dist(rng)};
+        double angle = 2 * pi * unit(rng);
+        std::size_t length = length_dist(rng);
+
+        while (route.size() < length) {
+            const Point& p = _positions[route.back()];
+            double best_score = 0.3;
+            NodeID best = static_cast<NodeID>(_params.n_stops);
+
+            index.for_each_near(p.x, p.y, search_radius, [&](const NodeID& t) {
+                if (std::find(route.begin(), route.end(), t) != route.end()) return;
+
+                double dx = _positions[t].x - p.x;
+                double dy = _positions[t].y - p.y;
+                double d = std::hypot(dx, dy);
+
+                if (d == 0 || d > search_radius) return;
+
+                double score = (dx * std::cos(angle) + dy * std::sin(angle)) / d;
+                if (score > best_score) {
+                    best_score = score;
+                    best = t;
+                }
+            });
+
+            if (best == _params.n_stops) break;
+
+            route.push_back(best);
+            angle += drift(rng);
+        }
+
+        // Distribute the trips evenly over the routes, or run every route during the whole service
+        std::size_t n_trips = 0;
+        if (_params.n_trips > 0) {
+            n_trips = _params.n_trips / n_routes + (r < _params.n_trips % n_routes ? 1 : 0);
+            if (n_trips == 0) continue;
+        }
+
+        Time headway = headway_dist(rng);
+        Time offset = static_cast<Time>(unit(rng) * headway);
+
+        add_route(route, headway, _params.service_start + offset, n_trips);
+    }
+}
+
+
+// The cities are grids of stops on a square grid of cities, five times as far apart as their size, so that their
+// stops are clustered. The central station of each city is its stop closest to the centre, and the stations of
+// neighbouring cities are joined by intercity lines without any stop in between, which run four times less often
+// than the bus lines.
+void TimetableGenerator::generate_cities() {
+    std::mt19937 rng {_params.seed};
+    std::uniform_int_distribution<Time> headway_dist {_params.min_headway, _params.max_headway};
+
+    std::size_t n_cities = _params.n_lines > 0 ? _params.n_lines : std::max<std::size_t>(1, _params.n_stops / 250);
+    auto n_city_cols = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(n_cities))));
+    double city_side = _params.stop_spacing * std::ceil(std::sqrt(static_cast<double>(_params.n_stops / n_cities)));
+    double city_spacing = 5 * city_side;
+
+    std::vector<NodeID> stations;
+
+    for (std::size_t city = 0; city < n_cities; ++city) {
+        std::size_t n_stops = _params.n_stops / n_cities + (city < _params.n_stops % n_cities ? 1 : 0);
+        Point corner {(city % n_city_cols) * city_spacing, (city / n_city_cols) * city_spacing};
+        auto first = static_cast<NodeID>(_positions.size());
+
+        add_grid(n_stops, corner, rng);
+
+        Point centre {corner.x + city_side / 2, corner.y + city_side / 2};
+        NodeID station = first;
+
+        for (auto s = first; s < _positions.size(); ++s) {
+            if (std::hypot(_positions[s].x - centre.x, _positions[s].y - centre.y) <
+                std::hypot(_positions[station].x - centre.x, _positions[station].y - centre.y)) {
+                station = s;
+            }
+        }
+
+        stations.push_back(station);
+    }
+
+    for (std::size_t city = 0; city < n_cities; ++city) {
+        std::vector<std::size_t> neighbours;
+
+        if (city % n_city_cols + 1 < n_city_cols && city + 1 < n_cities) neighbours.push_back(city + 1);
+        if (city + n_city_cols < n_cities) neighbours.push_back(city + n_city_cols);
+
+        for (const auto& neighbour: neighbours) {
+            for (const auto& line: {std::vector<NodeID> {stations[city], stations[neighbour]},
+                                    std::vector<NodeID> {stations[neighbour], stations[city]}}) {
+                add_route(line, 4 * headway_dist(rng), _params.service_start, 0);
+            }
+        }
+    }
+}
+
+
+void TimetableGenerator::add_route(const std::vector<NodeID>& stops, Time headway, Time first_departure,
+                                   std::size_t n_trips) {
+    if (stops.size() < 2) return;
+
+    Route route;
+    route.stops = stops;
+    route.headway = std::max<Time>(1, headway);
+    route.first_departure = first_departure;
+
+    if (n_trips == 0) {
+        n_trips = first_departure < _params.service_end ?
+                  (_params.service_end - first_departure) / route.headway + 1 : 1;
+    }
+    route.n_trips = n_trips;
+
+    for (size_t i = 0; i + 1 < stops.size(); ++i) {
+        auto hop_time = static_cast<Time>(std::round(distance(stops[i], stops[i + 1]) / _params.vehicle_speed));
+        route.hop_times.push_back(std::max<Time>(30, hop_time));
+    }
+
+    _routes.push_back(std::move(route));
+}
+
+
+double TimetableGenerator::distance(const NodeID& s, const NodeID& t) const {
+    return std::hypot(_positions[s].x - _positions[t].x, _positions[s].y - _positions[t].y);
+}
+
+
+Time TimetableGenerator::walking_time(double dist) const {
+    return static_cast<Time>(std::ceil(dist / _params.walking_speed));
+}
+
+
+// The stops are grouped greedily into walking areas, in which every two stops are within the walking radius
+// of each other. An area is grown from its stop of the smallest id, by the stops in increasing distance from it.
+// Walking is only possible inside the areas, so that the footpaths are transitively closed: the footpaths
+// between all the stops within the radius would chain into walks of any length through the network.
+std::vector<std::vector<NodeID>> TimetableGenerator::make_walking_areas() const {
+    std::vector<double> xs, ys;
+    for (const auto& p: _positions) {
+        xs.push_back(p.x);
+        ys.push_back(p.y);
+    }
+
+    SpatialIndex index {xs, ys, _params.walking_radius};
+    std::vector<bool> is_assigned(_positions.size());
+    std::vector<std::vector<NodeID>> areas;
+
+    for (NodeID s = 0; s < _positions.size(); ++s) {
+        if (is_assigned[s]) continue;
+
+        std::vector<std::pair<double, NodeID>> candidates;
+
+        index.for_each_near(_positions[s].x, _positions[s].y, _params.walking_radius, [&](const NodeID& t) {
+            double d = distance(s, t);
+
+            if (t != s && !is_assigned[t] && d <= _params.walking_radius) {
+                candidates.emplace_back(d, t);
+            }
+        });
+
+        std::sort(candidates.begin(), candidates.end());
+
+        std::vector<NodeID> area {s};
+        is_assigned[s] = true;
+
+        for (const auto& candidate: candidates) {
+            const auto& t = candidate.second;
+
+            if (std::all_of(area.begin(), area.end(), [&](const NodeID& u) {
+                return distance(t, u) <= _params.walking_radius;
+            })) {
+                area.push_back(t);
+                is_assigned[t] = true;
+            }
+        }
+
+        std::sort(area.begin(), area.end());
+        areas.push_back(std::move(area));
+    }
+
+    return areas;
+}
+
+
+// The footpaths join every two stops of a walking area, the walking times of the direct walks satisfy
+// the triangle inequality. The hub labels of the i-th stop of an area are the first i stops of the area,
+// so that the smaller of two stops is a hub of both, and the labels give the exact walking times.
+void TimetableGenerator::make_footpaths() {
+    std::vector<std::vector<NodeID>> areas = make_walking_areas();
+    std::vector<const std::vector<NodeID>*> area_of(_positions.size());
+
+    for (const auto& area: areas) {
+        for (const auto& s: area) {
+            area_of[s] = &area;
+        }
+    }
+
+    for (NodeID s = 0; s < _positions.size(); ++s) {
+        // The transfer from a stop to itself is needed to start a journey at the stop
+        _transfers.emplace_back(s, s, 0);
+
+        for (const auto& t: *area_of[s]) {
+            if (t != s) _transfers.emplace_back(s, t, walking_time(distance(s, t)));
+        }
+
+        for (const auto& hub_id: *area_of[s]) {
+            if (hub_id > s) break;
+
+            Time time = hub_id == s ? 0 : walking_time(distance(s, hub_id));
+            _in_hubs.emplace_back(s, hub_id, time);
+            _out_hubs.emplace_back(s, hub_id, time);
+        }
+    }
+}
+
+
+void TimetableGenerator::for_each_trip(const std::function<void(const TripID&, const Events&)>& callback) const {
+    TripID trip_id = 0;
+    Events events;
+
+    for (const auto& route: _routes) {
+        for (std::size_t k = 0; k < route.n_trips; ++k) {
+            events.clear();
+
+            Time t = route.first_departure + static_cast<Time>(k) * route.headway;
+            events.emplace_back(route.stops[0], t, t, 0);
+
+            for (size_t i = 0; i < route.hop_times.size(); ++i) {
+                Time arr = t + route.hop_times[i];
+                t = arr + _params.dwell_time;
+                events.emplace_back(route.stops[i + 1], arr, t, static_cast<int>(i + 1));
+            }
+
+            callback(trip_id++, events);
+        }
+    }
+}
+
+
+TimetableData TimetableGenerator::generate() const {
+    TimetableData data;
+
+    data.n_stops = _positions.size();
+    data.transfers = _transfers;
+    data.in_hubs = _in_hubs;
+    data.out_hubs = _out_hubs;
+
+    for_each_trip([&](const TripID& trip_id, const Events& events) {
+        data.trip_events[trip_id] = events;
+    });
+
+    return data;
+}
+
+
+void TimetableGenerator::write(const std::string& path) const {
+    make_directories(path);
+
+    std::vector<bool> is_served(_positions.size());
+
+    ogzstream stop_routes_file {(path + "stop_routes.csv.gz").c_str()};
+    stop_routes_file << "stop_id,route_id\n";
+
+    for (size_t r = 0; r < _routes.size(); ++r) {
+        for (const auto& stop_id: _routes[r].stops) {
+            is_served[stop_id] = true;
+            stop_routes_file << stop_id << ',' << r << '\n';
+        }
+    }
+
+    // Every stop must appear in the file since the stops are created from it
+    for (NodeID s = 0; s < _positions.size(); ++s) {
+        if (!is_served[s]) {
+            stop_routes_file << s << ",\n";
+        }
+    }
+
+    stop_routes_file.close();
+
+    ogzstream transfers_file {(path + "transfers.csv.gz").c_str()};
+    transfers_file << "from_stop_id,to_stop_id,min_transfer_time\n";
+
+    for (const auto& transfer: _transfers) {
+        transfers_file << transfer.source_id << ',' << transfer.target_id << ',' << transfer.time << '\n';
+    }
+
+    transfers_file.close();
+
+    // The coordinates of the stops in meters, which are not needed by the queries but give a geometric
+    // partition of the stops to CSA Accelerated
+    ogzstream positions_file {(path + "stop_positions.csv.gz").c_str()};
+    positions_file << "stop_id,x,y\n";
+
+    for (NodeID s = 0; s < _positions.size(); ++s) {
+        positions_file << s << ',' << _positions[s].x << ',' << _positions[s].y << '\n';
+    }
+
+    positions_file.close();
+
+    ogzstream in_hubs_file {(path + "in_hubs.gr.gz").c_str()};
+    for (const auto& hub_link: _in_hubs) {
+        in_hubs_file << hub_link.hub_id << ' ' << hub_link.stop_id << ' ' << hub_link.time << '\n';
+    }
+    in_hubs_file.close();
+
+    ogzstream out_hubs_file {(path + "out_hubs.gr.gz").c_str()};
+    for (const auto& hub_link: _out_hubs) {
+        out_hubs_file << hub_link.stop_id << ' ' << hub_link.hub_id << ' ' << hub_link.time << '\n';
+    }
+    out_hubs_file.close();
+
+    ogzstream stop_times_file {(path + "stop_times.csv.gz").c_str()};
+    stop_times_file << "trip_id,arrival_time,departure_time,stop_id,stop_sequence\n";
+
+    for_each_trip([&](const TripID& trip_id, const Events& events) {
+        for (const auto& event: events) {
+            stop_times_file << trip_id << ',' << event.arrival_time << ',' << event.departure_time << ','
+                            << event.stop_id << ',' << event.stop_sequence << '\n';
+        }
+    });
+
+    stop_times_file.close();
+
+    std::mt19937 rng {_params.seed + 1};
+    std::uniform_int_distribution<NodeID> stop_dist {0, static_cast<NodeID>(_positions.size() - 1)};
+    std::uniform_int_distribution<Time> time_dist {_params.service_start, _params.service_end - 1};
+
+    std::ofstream queries_file {path + "queries.csv"};
+    queries_file << "rank,source,target,time\n";
+
+    for (std::size_t i = 0; i < _params.n_queries; ++i) {
+        NodeID source_id = stop_dist(rng);
+        NodeID target_id = stop_dist(rng);
+        queries_file << 0 << ',' << source_id << ',' << target_id << ',' << time_dist(rng) << '\n';
+    }
+}
+
+
+std::size_t TimetableGenerator::n_connections() const {
+    std::size_t count = 0;
+
+    for (const auto& route: _routes) {
+        count += route.n_trips * route.hop_times.size();
+    }
+
+    return count;
+}
+
+
+void TimetableGenerator::summary() const {
+    std::size_t n_trips = 0;
+
+    for (const auto& route: _routes) {
+        n_trips += route.n_trips;
+    }
+
+    std::cout << std::string(80, '-') << std::endl;
+
+    std::cout << "Summary of the generated network:" << std::endl;
+    std::cout << _positions.size() << " stops" << std::endl;
+    std::cout << _routes.size() << " routes" << std::endl;
+    std::cout << n_trips << " trips" << std::endl;
+    std::cout << n_connections() << " connections" << std::endl;
+    std::cout << _transfers.size() - _positions.size() << " footpaths" << std::endl;
+
+    std::cout << std::string(80, '-') << std::endl;
+}
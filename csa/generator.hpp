@@ -0,0 +1,112 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+enum class NetworkKind {
+    Grid,       // Bus lines along every row and every column of a square grid of stops
+    Radial,     // Metro lines crossing the city centre along pairs of opposite spokes
+    Country,    // Random routes over stops scattered uniformly on a large square
+    Cities      // Grids of bus lines in distant cities, whose central stations are joined by sparse intercity lines
+};
+
+
+struct GeneratorParams {
+    NetworkKind kind = NetworkKind::Grid;
+    std::size_t n_stops = 10000;
+
+    // The number of lines (spokes for the radial network, routes for the country network, cities for the
+    // network of cities), 0 means that the number is derived from the number of stops
+    std::size_t n_lines = 0;
+
+    // The total number of trips of the country network, 0 means that every route runs
+    // during the whole service period. The grid and radial networks always run during
+    // the whole service period
+    std::size_t n_trips = 0;
+
+    // Every line gets a headway drawn uniformly from [min_headway, max_headway]
+    Time min_headway = 600;
+    Time max_headway = 600;
+    Time service_start = 5 * 3600;
+    Time service_end = 24 * 3600;
+    Time dwell_time = 0;
+
+    // Distances are in meters and speeds in meters per second
+    double stop_spacing = 400;
+    double vehicle_speed = 8;
+    double walking_speed = 1.4;
+    double walking_radius = 500;
+
+    std::size_t n_queries = 10000;
+    unsigned seed = 42;
+};
+
+
+class TimetableGenerator {
+private:
+    struct Point {
+        double x, y;
+    };
+
+    struct Route {
+        std::vector<NodeID> stops;
+        std::vector<Time> hop_times;
+        Time headway;
+        Time first_departure;
+        std::size_t n_trips;
+    };
+
+    GeneratorParams _params;
+    std::vector<Point> _positions;
+    std::vector<Route> _routes;
+
+    // The footpaths and the hub labels, computed once for all the outputs
+    std::vector<Transfer> _transfers;
+    std::vector<HubLink> _in_hubs;
+    std::vector<HubLink> _out_hubs;
+
+    void generate_grid();
+
+    void generate_radial();
+
+    void generate_country();
+
+    void generate_cities();
+
+    void add_grid(const std::size_t& n_stops, const Point& corner, std::mt19937& rng);
+
+    void add_route(const std::vector<NodeID>& stops, Time headway, Time first_departure, std::size_t n_trips);
+
+    double distance(const NodeID& s, const NodeID& t) const;
+
+    Time walking_time(double dist) const;
+
+    std::vector<std::vector<NodeID>> make_walking_areas() const;
+
+    void make_footpaths();
+
+    void for_each_trip(const std::function<void(const TripID&, const Events&)>& callback) const;
+
+public:
+    explicit TimetableGenerator(const GeneratorParams& params);
+
+    // Build the raw timetable in memory, to be used with the Timetable(TimetableData) constructor
+    TimetableData generate() const;
+
+    // Write the dataset files in the same formats the Timetable parsers expect,
+    // together with a file of uniformly random queries
+    void write(const std::string& path) const;
+
+    std::size_t n_connections() const;
+
+    void summary() const;
+};
+
+
+#endif // GENERATOR_HPP
@@ -0,0 +1,70 @@
+#include <iostream>
+
+#include "clara.hpp"
+#include "generator.hpp"
+
+int main(int argc, char* argv[]) {
+    bool show_help;
+    std::string dataset_name;
+    std::string output;
+    std::string kind {"grid"};
+    GeneratorParams params;
+
+    auto cli_parser = clara::Arg(dataset_name, "name")("The name of the dataset to be generated") |
+                      clara::Opt(kind, "kind")["-k"]["--kind"]("The kind of network: grid, radial, country or cities") |
+                      clara::Opt(params.n_stops, "stops")["-s"]["--stops"]("The number of stops") |
+                      clara::Opt(params.n_trips, "trips")["-t"]["--trips"]("The number of trips (country only)") |
+                      clara::Opt(params.n_lines, "lines")["-l"]["--lines"]
+                              ("The number of spokes, routes or cities") |
+                      clara::Opt(params.min_headway, "seconds")["--min-headway"]("The minimum headway of a line") |
+                      clara::Opt(params.max_headway, "seconds")["--max-headway"]("The maximum headway of a line") |
+                      clara::Opt(params.n_queries, "queries")["-q"]["--queries"]("The number of random queries") |
+                      clara::Opt(params.seed, "seed")["--seed"]("The seed of the random generator") |
+                      clara::Opt(output, "directory")["-o"]["--output"]("The output directory") |
+                      clara::Help(show_help);
+
+    auto result = cli_parser.parse(clara::Args(argc, argv));
+    if (!result) {
+        std::cerr << "Error in command line: " << result.errorMessage() << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (show_help || dataset_name.empty()) {
+        cli_parser.writeToStream(std::cout);
+        return 0;
+    }
+
+    if (kind == "grid") {
+        params.kind = NetworkKind::Grid;
+    } else if (kind == "radial") {
+        params.kind = NetworkKind::Radial;
+    } else if (kind == "country") {
+        params.kind = NetworkKind::Country;
+    } else if (kind == "cities") {
+        params.kind = NetworkKind::Cities;
+    } else {
+        std::cerr << "Error in command line: Unknown network kind '" << kind << "'" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+
+    params.max_headway = std::max(params.min_headway, params.max_headway);
+
+    // By default, write to the directory that the Timetable reads the dataset from
+    if (output.empty()) {
+        output = "../../Public-Transit-Data/" + dataset_name + "/";
+    } else if (output.back() != '/') {
+        output += '/';
+    }
+
+    Timer timer;
+
+    TimetableGenerator generator {params};
+    generator.summary();
+    generator.write(output);
+
+    std::cout << "Dataset written to " << output << std::endl;
+    std::cout << "Time elapsed: " << timer.elapsed() << timer.unit() << std::endl;
+
+    return 0;
+}
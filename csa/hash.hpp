@@ -0,0 +1,50 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <cstdint>
+
+#include "data_structure.hpp"
+
+
+// The FNV-1a hash of a sequence of integers, recorded with a persisted preprocessing
+// to recognise the data it was computed from
+class Fnv1aHash {
+private:
+    uint64_t _value = 14695981039346656037ULL;
+
+public:
+    void add(const uint64_t& value) {
+        for (int i = 0; i < 8; ++i) {
+            _value ^= (value >> (8 * i)) & 0xff;
+            _value *= 1099511628211ULL;
+        }
+    }
+
+    uint64_t value() const { return _value; }
+};
+
+
+// The hash of the connections and the footpaths of a timetable, from which most preprocessings are computed
+inline Fnv1aHash timetable_hash(const Timetable& timetable) {
+    Fnv1aHash hash;
+
+    for (const auto& conn: timetable.connections) {
+        hash.add(conn.trip_id);
+        hash.add(conn.departure_stop_id);
+        hash.add(conn.arrival_stop_id);
+        hash.add(conn.departure_time);
+        hash.add(conn.arrival_time);
+    }
+
+    for (const auto& stop: timetable.stops) {
+        for (const auto& transfer: timetable.transfers(stop.id)) {
+            hash.add(transfer.source_id);
+            hash.add(transfer.target_id);
+            hash.add(transfer.time);
+        }
+    }
+
+    return hash;
+}
+
+#endif // HASH_HPP
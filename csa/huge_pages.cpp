@@ -0,0 +1,101 @@
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <unordered_map>
+
+#include "config.hpp"
+#include "huge_pages.hpp"
+
+
+// The sizes of the mapped blocks, the blocks which are not found here were allocated with operator new.
+// The timetable only has a few large arrays, thus the lock is not contended.
+static std::mutex& mapped_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+
+static std::unordered_map<void*, std::size_t>& mapped_blocks() {
+    static std::unordered_map<void*, std::size_t> blocks;
+    return blocks;
+}
+
+
+static void* map_huge(std::size_t size) {
+    void* pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (pointer != MAP_FAILED) {
+        return pointer;
+    }
+
+    // No huge pages are reserved, map one more huge page than needed and trim the mapping
+    // to a 2 MB boundary, so that the kernel can back the whole region with transparent huge pages
+    pointer = mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (pointer == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    auto address = reinterpret_cast<uintptr_t>(pointer);
+    auto aligned = (address + huge_page_size - 1) / huge_page_size * huge_page_size;
+    auto head = aligned - address;
+
+    if (head > 0) {
+        munmap(pointer, head);
+    }
+    munmap(reinterpret_cast<void*>(aligned + size), huge_page_size - head);
+
+    // The advice is only a hint, the region stays usable with 4 KB pages if THP is disabled
+    madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+
+    return reinterpret_cast<void*>(aligned);
+}
+
+
+void* allocate_huge(std::size_t bytes) {
+    if (!use_huge_pages || bytes < huge_page_size) {
+        return ::operator new(bytes);
+    }
+
+    std::size_t size = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    void* pointer = map_huge(size);
+
+    std::lock_guard<std::mutex> lock {mapped_mutex()};
+    mapped_blocks()[pointer] = size;
+
+    return pointer;
+}
+
+
+void deallocate_huge(void* pointer) {
+    std::size_t size = 0;
+
+    {
+        std::lock_guard<std::mutex> lock {mapped_mutex()};
+        auto it = mapped_blocks().find(pointer);
+
+        if (it != mapped_blocks().end()) {
+            size = it->second;
+            mapped_blocks().erase(it);
+        }
+    }
+
+    if (size > 0) {
+        munmap(pointer, size);
+    } else {
+        ::operator delete(pointer);
+    }
+}
+
+
+std::size_t huge_page_bytes() {
+    std::lock_guard<std::mutex> lock {mapped_mutex()};
+    std::size_t total = 0;
+
+    for (const auto& kv: mapped_blocks()) {
+        total += kv.second;
+    }
+
+    return total;
+}
@@ -0,0 +1,49 @@
+#ifndef HUGE_PAGES_HPP
+#define HUGE_PAGES_HPP
+
+#include <cstddef>
+
+
+// The size of a huge page on x86-64
+const std::size_t huge_page_size = std::size_t {2} << 20;
+
+// Allocate a block of at least the given size. With --huge-pages, the large blocks are backed by
+// reserved 2 MB pages (MAP_HUGETLB), or if none are reserved, by a 2 MB aligned region advised
+// for transparent huge pages. The other blocks come from the default allocator.
+void* allocate_huge(std::size_t bytes);
+
+void deallocate_huge(void* pointer);
+
+// The number of bytes currently mapped for the large blocks
+std::size_t huge_page_bytes();
+
+
+// Allocates the elements of the timetable arrays with allocate_huge, the large arrays which
+// are scanned or accessed randomly by the queries then need fewer TLB entries
+template<class T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    HugePageAllocator() = default;
+
+    template<class U>
+    HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(allocate_huge(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t) {
+        deallocate_huge(pointer);
+    }
+};
+
+
+template<class T, class U>
+bool operator==(const HugePageAllocator<T>&, const HugePageAllocator<U>&) { return true; }
+
+template<class T, class U>
+bool operator!=(const HugePageAllocator<T>&, const HugePageAllocator<U>&) { return false; }
+
+#endif // HUGE_PAGES_HPP
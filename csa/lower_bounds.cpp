@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <tuple>
+
+#include "config.hpp"
+#include "lower_bounds.hpp"
+
+
+StopGraph::StopGraph(std::shared_ptr<const Timetable> timetable) : _timetable {std::move(timetable)} {
+    // The edges as (head, tail, time), only the fastest of the parallel edges is kept
+    std::vector<std::tuple<NodeID, NodeID, Time>> all_edges;
+
+    for (const auto& conn: _timetable->connections) {
+        all_edges.emplace_back(conn.arrival_stop_id, conn.departure_stop_id, conn.arrival_time - conn.departure_time);
+    }
+
+    for (const auto& stop: _timetable->stops) {
+        if (!use_hl) {
+            for (const auto& transfer: _timetable->transfers(stop.id)) {
+                all_edges.emplace_back(transfer.target_id, transfer.source_id, transfer.time);
+            }
+        } else {
+            for (const auto& hub_link: _timetable->out_hubs(stop.id)) {
+                all_edges.emplace_back(hub_link.hub_id, stop.id, hub_link.time);
+            }
+
+            for (const auto& hub_link: _timetable->in_hubs(stop.id)) {
+                all_edges.emplace_back(stop.id, hub_link.hub_id, hub_link.time);
+            }
+        }
+    }
+
+    std::sort(all_edges.begin(), all_edges.end());
+
+    edge_offsets.assign(_timetable->max_node_id + 2, 0);
+
+    for (std::size_t i = 0; i < all_edges.size(); ++i) {
+        const auto& head_id = std::get<0>(all_edges[i]);
+        const auto& tail_id = std::get<1>(all_edges[i]);
+
+        if (i > 0 && head_id == std::get<0>(all_edges[i - 1]) && tail_id == std::get<1>(all_edges[i - 1])) continue;
+
+        edges.push_back({tail_id, std::get<2>(all_edges[i])});
+        ++edge_offsets[head_id + 1];
+    }
+
+    for (std::size_t i = 1; i < edge_offsets.size(); ++i) {
+        edge_offsets[i] += edge_offsets[i - 1];
+    }
+}
+
+
+// Dijkstra's algorithm from the target on the reversed edges
+std::vector<Time> StopGraph::lower_bounds(const NodeID& target_id) const {
+    using Entry = std::pair<Time, NodeID>;
+
+    std::vector<Time> times(edge_offsets.size() - 1, INF);
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+
+    times[target_id] = 0;
+    queue.emplace(0, target_id);
+
+    while (!queue.empty()) {
+        auto entry = queue.top();
+        queue.pop();
+
+        const auto& time = entry.first;
+        const auto& node_id = entry.second;
+
+        if (time > times[node_id]) continue;
+
+        for (auto i = edge_offsets[node_id]; i < edge_offsets[node_id + 1]; ++i) {
+            const auto& edge = edges[i];
+
+            if (time + edge.time < times[edge.tail_id]) {
+                times[edge.tail_id] = time + edge.time;
+                queue.emplace(times[edge.tail_id], edge.tail_id);
+            }
+        }
+    }
+
+    return times;
+}
+
+
+std::shared_ptr<const std::vector<Time>> LowerBoundCache::get(const StopGraph& graph, const uint64_t& generation,
+                                                              const NodeID& target_id) {
+    std::shared_ptr<const std::vector<Time>> bounds;
+
+    if (!_bounds.find(target_id, generation, bounds)) {
+        bounds = std::make_shared<const std::vector<Time>>(graph.lower_bounds(target_id));
+        _bounds.insert(target_id, bounds, generation);
+    }
+
+    return bounds;
+}
+
+
+void LowerBoundCache::report() {
+    report_cache("Lower bound", _bounds.hits(), _bounds.misses(), _bounds.size(), _bounds.memory());
+}
@@ -0,0 +1,51 @@
+#ifndef LOWER_BOUNDS_HPP
+#define LOWER_BOUNDS_HPP
+
+#include <memory>
+#include <vector>
+
+#include "data_structure.hpp"
+#include "query_cache.hpp"
+
+
+// The graph of the stops of a timetable, with an edge for the fastest connection between two stops
+// and for each footpath, or each link to and from the hubs with --hl. The edges are stored by their head,
+// the edges to the node v are between the offsets edge_offsets[v] and edge_offsets[v + 1].
+class StopGraph {
+private:
+    std::shared_ptr<const Timetable> _timetable;
+
+public:
+    struct Edge {
+        NodeID tail_id;
+        Time time;
+    };
+
+    std::vector<uint64_t> edge_offsets;
+    std::vector<Edge> edges;
+
+    explicit StopGraph(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _timetable; }
+
+    // The minimum travel times from every node to the target without waiting, INF if the target cannot be reached
+    std::vector<Time> lower_bounds(const NodeID& target_id) const;
+};
+
+
+// The lower bounds of the recent targets, shared by the workers and evicted with the CLOCK algorithm.
+// The entries are only valid for the generation of the snapshot of the store the graph was built on.
+class LowerBoundCache {
+private:
+    ClockCache<NodeID, std::shared_ptr<const std::vector<Time>>> _bounds;
+
+public:
+    explicit LowerBoundCache(const std::size_t& capacity) : _bounds {capacity} {};
+
+    std::shared_ptr<const std::vector<Time>> get(const StopGraph& graph, const uint64_t& generation,
+                                                 const NodeID& target_id);
+
+    void report();
+};
+
+#endif // LOWER_BOUNDS_HPP
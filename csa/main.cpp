@@ -5,17 +5,55 @@
 #include "data_structure.hpp"
 #include "experiments.hpp"
 
-std::string name;
-bool use_hl;
-bool profile;
-bool ranked;
-
 int main(int argc, char* argv[]) {
     bool show_help;
     auto cli_parser = clara::Arg(name, "name")("The name of the dataset to be used in the algorithm") |
                       clara::Opt(use_hl)["--hl"]("Unrestricted walking with hub labelling") |
                       clara::Opt(profile)["-p"]["--profile"]("Run profile query") |
+                      clara::Opt(latest)["-l"]["--latest"]
+                              ("Run latest departure query, the time of the queries being the arrival time") |
+                      clara::Opt(board, "departures")["--board"]
+                              ("Look up the given number of next departures from the source of the queries") |
                       clara::Opt(ranked)["-r"]["--ranked"]("Use ranked queries") |
+                      clara::Opt(renumber)["--renumber"]("Renumber the stops and trips for locality") |
+                      clara::Opt(prune)["--prune"]
+                              ("Remove the connections dominated by another one between the same stops") |
+                      clara::Opt(reload_interval, "queries")["--reload"]
+                              ("Reload the timetable in the background every given number of queries") |
+                      clara::Opt(snapshot_path, "file")["--snapshot"]
+                              ("Map the timetable from a binary snapshot, created from the dataset if missing") |
+                      clara::Opt(use_huge_pages)["--huge-pages"]("Allocate the large arrays of the timetable in 2 MB pages") |
+                      clara::Opt(n_threads, "threads")["-j"]["--threads"]
+                              ("Run the queries in parallel, with a replica of the timetable on each NUMA node") |
+                      clara::Opt(schedule, "departure|region")["--schedule"]
+                              ("Run the queries ordered by departure time, or by source region then departure time") |
+                      clara::Opt(cache_size, "entries")["--cache"]("Cache the results of the queries") |
+                      clara::Opt(cache_bucket, "seconds")["--cache-bucket"]
+                              ("The width of the departure time buckets of the cache, exact with 1 second") |
+                      clara::Opt(profile_cache)["--profile-cache"]
+                              ("Answer the earliest arrival queries from cached profiles") |
+                      clara::Opt(all_to_one)["--all-to-one"]
+                              ("Answer the profile queries to the same target with a single backward scan") |
+                      clara::Opt(nearby, "seconds")["--nearby"]
+                              ("Query from and to all the stops within the given walking time of the source and target") |
+                      clara::Opt(algorithm, "algorithm")["-a"]["--algorithm"]
+                              ("The algorithm answering the queries: csa by default, raptor, tb for Trip-Based, "
+                               "csaccel for CSA Accelerated or tp for Transfer Patterns") |
+                      clara::Opt(cells, "cells")["--cells"]("The number of cells of CSA Accelerated, 32 by default") |
+                      clara::Opt(lower_bound_targets, "targets")["--lower-bounds"]
+                              ("Prune the earliest arrival queries with lower bounds of the travel times to the "
+                               "target, cached for the given number of targets") |
+                      clara::Opt(kernel, "kernel")["--kernel"]
+                              ("The loop over the connections of the earliest arrival queries: scalar by default, "
+                               "block to skip the blocks of connections that cannot be boarded, or prefetch "
+                               "to prefetch the state of the connections ahead") |
+                      clara::Opt(prefetch_distance, "distance")["--prefetch"]
+                              ("How far ahead the prefetch kernel prefetches, 16 connections by default") |
+                      clara::Opt(prefetch_sweep)["--prefetch-sweep"]
+                              ("Time the prefetch kernel with a range of prefetch distances and report the best") |
+                      clara::Opt(narrow)["--narrow"]
+                              ("Store the times of the earliest arrival queries in 16 bits, falling back to the "
+                               "basic scan out of their range") |
                       clara::Help(show_help);
 
     auto result = cli_parser.parse(clara::Args(argc, argv));
@@ -28,9 +66,99 @@ int main(int argc, char* argv[]) {
         cli_parser.writeToStream(std::cout);
         return 0;
     }
+    if (latest && (profile || cache_size > 0 || nearby > 0)) {
+        std::cerr << "Error in command line: --latest cannot be used with --profile, --cache or --nearby" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (all_to_one && !profile) {
+        std::cerr << "Error in command line: --all-to-one requires --profile" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (all_to_one && (algorithm != "csa" || cache_size > 0 || board > 0 || nearby > 0)) {
+        std::cerr << "Error in command line: --all-to-one cannot be used with --algorithm, --cache, --board or --nearby"
+                  << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (nearby > 0 && (profile || use_hl)) {
+        std::cerr << "Error in command line: --nearby cannot be used with --profile or --hl" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (!schedule.empty() && schedule != "departure" && schedule != "region") {
+        std::cerr << "Error in command line: Unknown schedule '" << schedule << "'" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (algorithm != "csa" && algorithm != "raptor" && algorithm != "tb" && algorithm != "csaccel" &&
+        algorithm != "tp") {
+        std::cerr << "Error in command line: Unknown algorithm '" << algorithm << "'" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (algorithm != "csa" && (latest || board > 0 || cache_size > 0 || nearby > 0)) {
+        std::cerr << "Error in command line: --algorithm " << algorithm
+                  << " cannot be used with --latest, --board, --cache or --nearby" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if ((algorithm == "raptor" || algorithm == "csaccel" || algorithm == "tp") && profile) {
+        std::cerr << "Error in command line: --algorithm " << algorithm << " cannot be used with --profile" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if ((algorithm == "tb" || algorithm == "csaccel" || algorithm == "tp") && use_hl) {
+        std::cerr << "Error in command line: --algorithm " << algorithm << " cannot be used with --hl" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (prune && (board > 0 || algorithm != "csa")) {
+        std::cerr << "Error in command line: --prune cannot be used with "
+                  << (board > 0 ? "--board" : "--algorithm " + algorithm) << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (lower_bound_targets > 0 &&
+        (profile || latest || board > 0 || cache_size > 0 || nearby > 0 || algorithm != "csa")) {
+        std::cerr << "Error in command line: --lower-bounds can only be used with the earliest arrival queries "
+                  << "of the basic CSA, without --cache or --nearby" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (kernel != "scalar" && kernel != "block" && kernel != "prefetch") {
+        std::cerr << "Error in command line: Unknown kernel '" << kernel << "'" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (kernel != "scalar" && (profile || latest || board > 0 || cache_size > 0 || nearby > 0 || use_hl ||
+                               lower_bound_targets > 0 || algorithm != "csa")) {
+        std::cerr << "Error in command line: --kernel " << kernel << " can only be used with the earliest arrival "
+                  << "queries of the basic CSA, without --hl, --cache, --nearby or --lower-bounds" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (prefetch_sweep && kernel != "prefetch") {
+        std::cerr << "Error in command line: --prefetch-sweep requires --kernel prefetch" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
+    if (narrow && (profile || latest || board > 0 || cache_size > 0 || nearby > 0 || use_hl ||
+                   lower_bound_targets > 0 || algorithm != "csa" || kernel != "scalar")) {
+        std::cerr << "Error in command line: --narrow can only be used with the earliest arrival queries of the basic "
+                  << "CSA, without --hl, --cache, --nearby, --lower-bounds or --kernel" << std::endl;
+        cli_parser.writeToStream(std::cout);
+        exit(1);
+    }
 
     Experiment exp;
-    exp.run();
+
+    if (prefetch_sweep) {
+        exp.sweep_prefetch();
+    } else {
+        exp.run();
+    }
 
     return 0;
 }
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "narrow_times.hpp"
+
+
+static void fail(const std::string& message) {
+    std::cerr << "Error occurred while building the narrow times: " << message << std::endl;
+    std::cerr << "Exiting..." << std::endl;
+    exit(1);
+}
+
+
+NarrowTimetable::NarrowTimetable(std::shared_ptr<const Timetable> timetable) : _timetable {std::move(timetable)} {
+    const auto& connections = _timetable->connections;
+
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+        const auto& conn = connections[i];
+
+        if (conn.arrival_time - conn.departure_time >= NARROW_INF) {
+            fail("a connection of the trip " + std::to_string(conn.trip_id) + " lasts more than " +
+                 std::to_string(NARROW_INF - 1) + " seconds");
+        }
+
+        if (bucket_bases.empty() || conn.arrival_time - bucket_bases.back() >= NARROW_INF) {
+            bucket_bases.push_back(conn.departure_time);
+            bucket_offsets.push_back(i);
+        }
+
+        departure_offsets.push_back(static_cast<NarrowTime>(conn.departure_time - bucket_bases.back()));
+        arrival_offsets.push_back(static_cast<NarrowTime>(conn.arrival_time - bucket_bases.back()));
+        departure_stop_ids.push_back(conn.departure_stop_id);
+        arrival_stop_ids.push_back(conn.arrival_stop_id);
+        trip_ids.push_back(conn.trip_id);
+    }
+
+    bucket_offsets.push_back(connections.size());
+
+    transfer_offsets.push_back(0);
+
+    for (std::size_t stop_id = 0; stop_id < _timetable->stops.size(); ++stop_id) {
+        for (const auto& transfer: _timetable->transfers(static_cast<NodeID>(stop_id))) {
+            if (transfer.time >= NARROW_INF) {
+                fail("a footpath from the stop " + std::to_string(stop_id) + " lasts more than " +
+                     std::to_string(NARROW_INF - 1) + " seconds");
+            }
+
+            transfers.push_back({transfer.target_id, static_cast<NarrowTime>(transfer.time)});
+        }
+
+        transfer_offsets.push_back(transfers.size());
+    }
+
+    std::cout << "Narrow times: " << bucket_bases.size() << " buckets, " << memory() / 1e6 << " MB" << std::endl;
+}
+
+
+std::size_t NarrowTimetable::memory() const {
+    return bucket_bases.size() * sizeof(Time) + bucket_offsets.size() * sizeof(std::size_t) +
+           departure_offsets.size() * sizeof(NarrowTime) + arrival_offsets.size() * sizeof(NarrowTime) +
+           departure_stop_ids.size() * sizeof(NodeID) + arrival_stop_ids.size() * sizeof(NodeID) +
+           trip_ids.size() * sizeof(TripID) + transfer_offsets.size() * sizeof(std::size_t) +
+           transfers.size() * sizeof(NarrowTransfer);
+}
+
+
+NarrowScan::NarrowScan(std::shared_ptr<const NarrowTimetable> narrow) : _narrow {std::move(narrow)} {
+    earliest_arrival_time.assign(_narrow->snapshot()->max_node_id + 1, NARROW_INF);
+    trip_reached.assign(_narrow->snapshot()->max_trip_id / 32 + 1, 0);
+}
+
+
+// The walks arriving after the target, or out of range, are not stored
+void NarrowScan::walk(const NodeID& arr_id, const uint32_t& arrival_time, const NodeID& target_id) {
+    const uint32_t target_time = earliest_arrival_time[target_id];
+
+    for (auto k = _narrow->transfer_offsets[arr_id]; k < _narrow->transfer_offsets[arr_id + 1]; ++k) {
+        const auto& transfer = _narrow->transfers[k];
+        uint32_t tmp_time = arrival_time + transfer.time;
+
+        if (tmp_time > target_time) break;
+
+        if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+            earliest_arrival_time[transfer.target_id] = static_cast<NarrowTime>(tmp_time);
+        }
+    }
+}
+
+
+Time NarrowScan::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time) {
+    const auto& narrow = *_narrow;
+
+    std::fill(earliest_arrival_time.begin(), earliest_arrival_time.end(), NARROW_INF);
+    std::memset(trip_reached.data(), 0, trip_reached.size() * sizeof(uint32_t));
+
+    for (auto k = narrow.transfer_offsets[source_id]; k < narrow.transfer_offsets[source_id + 1]; ++k) {
+        const auto& transfer = narrow.transfers[k];
+        earliest_arrival_time[transfer.target_id] = std::min(earliest_arrival_time[transfer.target_id], transfer.time);
+    }
+
+    // The first connection departing not before departure_time is in the last bucket starting not after it,
+    // or at the start of the next bucket
+    auto bucket = static_cast<std::size_t>(std::upper_bound(narrow.bucket_bases.begin(), narrow.bucket_bases.end(),
+                                                            departure_time) - narrow.bucket_bases.begin());
+    std::size_t i = narrow.bucket_offsets[bucket];
+
+    if (bucket > 0) {
+        --bucket;
+
+        const auto& base = narrow.bucket_bases[bucket];
+        auto first = narrow.departure_offsets.begin() + narrow.bucket_offsets[bucket];
+        auto last = narrow.departure_offsets.begin() + narrow.bucket_offsets[bucket + 1];
+
+        i = static_cast<std::size_t>(std::lower_bound(first, last, departure_time - base, [](const NarrowTime& offset,
+                                                                                          const Time& time) {
+            return offset < time;
+        }) - narrow.departure_offsets.begin());
+    }
+
+    for (; bucket + 1 < narrow.bucket_offsets.size(); ++bucket) {
+        // The times of the connections of the bucket relative to departure_time, which can be negative
+        // before the first connection of the query
+        const auto shift = static_cast<int32_t>(narrow.bucket_bases[bucket]) - static_cast<int32_t>(departure_time);
+
+        // The target pruning also ends the scan at the connections departing out of range
+        if (shift >= static_cast<int32_t>(earliest_arrival_time[target_id])) break;
+
+        const auto& last = narrow.bucket_offsets[bucket + 1];
+
+        for (; i < last; ++i) {
+            const auto conn_departure = static_cast<uint32_t>(shift + narrow.departure_offsets[i]);
+
+            if (earliest_arrival_time[target_id] <= conn_departure) break;
+
+            const auto& trip_id = narrow.trip_ids[i];
+            auto& word = trip_reached[trip_id >> 5];
+            const uint32_t bit = 1u << (trip_id & 31);
+
+            if ((word & bit) != 0 || earliest_arrival_time[narrow.departure_stop_ids[i]] <= conn_departure) {
+                word |= bit;
+
+                const auto& arr_id = narrow.arrival_stop_ids[i];
+                const auto conn_arrival = static_cast<uint32_t>(shift + narrow.arrival_offsets[i]);
+
+                if (conn_arrival < earliest_arrival_time[arr_id]) {
+                    earliest_arrival_time[arr_id] = static_cast<NarrowTime>(conn_arrival);
+
+                    walk(arr_id, conn_arrival, target_id);
+                }
+            }
+        }
+
+        if (i < last) break;
+    }
+
+    _out_of_range = earliest_arrival_time[target_id] == NARROW_INF;
+
+    return _out_of_range ? INF : departure_time + earliest_arrival_time[target_id];
+}
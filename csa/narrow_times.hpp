@@ -0,0 +1,76 @@
+#ifndef NARROW_TIMES_HPP
+#define NARROW_TIMES_HPP
+
+#include <memory>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+// A time in seconds stored in 16 bits, relative to a base time
+using NarrowTime = uint16_t;
+
+constexpr NarrowTime NARROW_INF = 0xFFFF;
+
+
+// The connections of a timetable with their times stored in 16 bits. The connections are split into buckets of
+// consecutive connections, and their times are the offsets from the departure time of the first connection of
+// their bucket. A new bucket starts at the first connection arriving too late for the current one, thus the
+// connections and the footpaths must last less than NARROW_INF seconds.
+class NarrowTimetable {
+private:
+    std::shared_ptr<const Timetable> _timetable;
+
+public:
+    struct NarrowTransfer {
+        NodeID target_id;
+        NarrowTime time;
+    };
+
+    std::vector<Time> bucket_bases;
+    std::vector<std::size_t> bucket_offsets;
+
+    std::vector<NarrowTime> departure_offsets;
+    std::vector<NarrowTime> arrival_offsets;
+    std::vector<NodeID> departure_stop_ids;
+    std::vector<NodeID> arrival_stop_ids;
+    std::vector<TripID> trip_ids;
+
+    // The footpaths from the stop v are between the offsets transfer_offsets[v] and transfer_offsets[v + 1]
+    std::vector<std::size_t> transfer_offsets;
+    std::vector<NarrowTransfer> transfers;
+
+    explicit NarrowTimetable(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _timetable; }
+
+    std::size_t memory() const;
+};
+
+
+// The earliest arrival query of ConnectionScan without hub labels on a NarrowTimetable. The earliest arrival times
+// of the stops are stored in 16 bits relative to the departure time of the query, thus only the journeys arriving
+// less than NARROW_INF seconds after the departure are found. When the target is not reached and a journey
+// was cut by this limit, the query is out of range, and its result is unknown.
+class NarrowScan {
+private:
+    std::shared_ptr<const NarrowTimetable> _narrow;
+
+    std::vector<NarrowTime> earliest_arrival_time;
+    std::vector<uint32_t> trip_reached;
+    bool _out_of_range = false;
+
+    inline void walk(const NodeID& arr_id, const uint32_t& arrival_time, const NodeID& target_id);
+
+public:
+    explicit NarrowScan(std::shared_ptr<const NarrowTimetable> narrow);
+
+    const std::shared_ptr<const NarrowTimetable>& timetable() const { return _narrow; }
+
+    Time query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+
+    // Whether the last query was out of range
+    bool out_of_range() const { return _out_of_range; }
+};
+
+#endif // NARROW_TIMES_HPP
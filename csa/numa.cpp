@@ -0,0 +1,92 @@
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <thread>
+
+#include "numa.hpp"
+
+
+// Parse a list of CPUs or nodes such as "0-3,8-11"
+static std::vector<int> parse_id_list(const std::string& list) {
+    std::vector<int> ids;
+    std::istringstream stream {list};
+    std::string range;
+
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range == "\n") continue;
+
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+        for (int id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+    }
+
+    return ids;
+}
+
+
+std::vector<std::vector<int>> numa_nodes() {
+    std::vector<std::vector<int>> nodes;
+
+    // The ids of the online nodes can have gaps, e.g. "0,2-3", the nodes are numbered from 0 in the order
+    // of their ids instead, as the indexes of their replicas
+    std::ifstream online_file {"/sys/devices/system/node/online"};
+    std::string online;
+
+    if (online_file) std::getline(online_file, online);
+
+    for (const auto& node: parse_id_list(online)) {
+        std::ifstream file {"/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"};
+        std::string list;
+
+        if (!file || !std::getline(file, list)) continue;
+
+        auto cpus = parse_id_list(list);
+
+        // A node with memory only has no CPU to run the queries
+        if (!cpus.empty()) {
+            nodes.push_back(cpus);
+        }
+    }
+
+    if (nodes.empty()) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < static_cast<int>(std::thread::hardware_concurrency()); ++cpu) {
+            cpus.push_back(cpu);
+        }
+        nodes.push_back(cpus);
+    }
+
+    return nodes;
+}
+
+
+void pin_thread(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (const auto& cpu: cpus) {
+        CPU_SET(cpu, &set);
+    }
+
+    // Pinning is only an optimisation, the thread keeps running anywhere if it fails
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+std::shared_ptr<const Timetable> copy_on_cpus(const std::shared_ptr<const Timetable>& timetable,
+                                              const std::vector<int>& cpus) {
+    std::shared_ptr<const Timetable> copy;
+
+    std::thread thread {[&]() {
+        pin_thread(cpus);
+        copy = std::make_shared<const Timetable>(*timetable);
+    }};
+    thread.join();
+
+    return copy;
+}
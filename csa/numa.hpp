@@ -0,0 +1,23 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <memory>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+// The CPUs of each online NUMA node with CPUs as listed in /sys/devices/system/node, in the order of the ids
+// of the nodes. A machine without this information is considered as a single node with all the CPUs.
+std::vector<std::vector<int>> numa_nodes();
+
+// Restrict the calling thread to the given CPUs
+void pin_thread(const std::vector<int>& cpus);
+
+// A copy of the timetable made by a thread running on the given CPUs. Linux places a page
+// on the node of the thread which touches it first, thus the arrays of the copy are
+// in the memory of the node of the CPUs.
+std::shared_ptr<const Timetable> copy_on_cpus(const std::shared_ptr<const Timetable>& timetable,
+                                              const std::vector<int>& cpus);
+
+#endif // NUMA_HPP
@@ -26,15 +26,17 @@ struct Pair {
 };
 
 
-class ProfilePareto {
+// The Pareto set of the pairs of a profile, the pairs can carry more data than the times
+template<class PairType>
+class BasicProfilePareto {
 public:
-    using pair_t = Pair;
+    using pair_t = PairType;
 
 private:
     std::vector<pair_t> _container;
 
 public:
-    ProfilePareto() {
+    BasicProfilePareto() {
         _container.reserve(256);
 
         // Initialise the container with a (∞, ∞) pair
@@ -100,19 +102,37 @@ public:
         return false;
     }
 
-    std::vector<pair_t>::reverse_iterator rbegin() {
+    // The pair of the best journey departing not before the given time. Since both the departure
+    // and the arrival times are decreasing, this is the last pair with a departure time at least the given one,
+    // the (∞, ∞) pair if there is none.
+    // TODO: compare the performance of linear search and binary search
+    const pair_t& best_pair(const Time& departure_time) const {
+        for (auto iter = _container.rbegin(); iter != _container.rend(); ++iter) {
+            if (iter->dep >= departure_time) {
+                return *iter;
+            }
+        }
+
+        return _container.front();
+    }
+
+    Time arrival_time(const Time& departure_time) const {
+        return best_pair(departure_time).arr;
+    }
+
+    typename std::vector<pair_t>::reverse_iterator rbegin() {
         return _container.rbegin();
     }
 
-    std::vector<pair_t>::reverse_iterator rend() {
+    typename std::vector<pair_t>::reverse_iterator rend() {
         return _container.rend();
     }
 
-    std::vector<pair_t>::const_iterator begin() const {
+    typename std::vector<pair_t>::const_iterator begin() const {
         return _container.begin();
     }
 
-    std::vector<pair_t>::const_iterator end() const {
+    typename std::vector<pair_t>::const_iterator end() const {
         return _container.end();
     }
 
@@ -121,4 +141,6 @@ public:
     }
 };
 
+using ProfilePareto = BasicProfilePareto<Pair>;
+
 #endif // PROFILE_PARETO_HPP
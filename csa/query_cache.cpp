@@ -0,0 +1,66 @@
+#include <iostream>
+
+#include "config.hpp"
+#include "query_cache.hpp"
+
+
+QueryKey QueryCache::key(const NodeID& source_id, const NodeID& target_id, const Time& departure_bucket,
+                         const bool& is_profile) {
+    return {source_id, target_id, departure_bucket, static_cast<uint32_t>(is_profile) << 1 | use_hl};
+}
+
+
+Time QueryCache::query(ConnectionScan& csa, const NodeID& source_id, const NodeID& target_id,
+                       const Time& departure_time) {
+    if (_profile_backed) {
+        ProfilePareto profile = profile_query(csa, source_id, target_id);
+
+        // The profile only contains the journeys with at least one connection
+        Time walking_time = csa.walking_time(source_id, target_id);
+        Time arrival_time = profile.arrival_time(departure_time);
+
+        return walking_time < INF ? std::min(arrival_time, departure_time + walking_time) : arrival_time;
+    }
+
+    const auto& gen = csa.generation();
+    auto query_key = key(source_id, target_id, departure_time / _bucket_width, false);
+    Time arrival_time;
+
+    if (!_arrival_times.find(query_key, gen, arrival_time)) {
+        arrival_time = csa.query(source_id, target_id, departure_time);
+        _arrival_times.insert(query_key, arrival_time, gen);
+    }
+
+    return arrival_time;
+}
+
+
+ProfilePareto QueryCache::profile_query(ConnectionScan& csa, const NodeID& source_id, const NodeID& target_id) {
+    const auto& gen = csa.generation();
+    auto query_key = key(source_id, target_id, 0, true);
+    ProfilePareto profile;
+
+    if (!_profiles.find(query_key, gen, profile)) {
+        profile = csa.profile_query(source_id, target_id);
+        _profiles.insert(query_key, profile, gen);
+    }
+
+    return profile;
+}
+
+
+void report_cache(const std::string& cache_name, const uint64_t& hits, const uint64_t& misses,
+                  const std::size_t& size, const std::size_t& memory) {
+    if (hits + misses == 0) return;
+
+    std::cout << cache_name << " cache: " << hits << " hits, " << misses << " misses, hit rate "
+              << 100.0 * hits / (hits + misses) << "%, " << size << " entries, "
+              << memory / 1024 << " KB" << std::endl;
+}
+
+
+void QueryCache::report() {
+    report_cache("Arrival time", _arrival_times.hits(), _arrival_times.misses(),
+                 _arrival_times.size(), _arrival_times.memory());
+    report_cache("Profile", _profiles.hits(), _profiles.misses(), _profiles.size(), _profiles.memory());
+}
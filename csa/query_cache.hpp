@@ -0,0 +1,211 @@
+#ifndef QUERY_CACHE_HPP
+#define QUERY_CACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "csa.hpp"
+#include "data_structure.hpp"
+#include "profile_pareto.hpp"
+
+
+// The heap memory owned by a cached value, in addition to the value itself
+inline std::size_t heap_bytes(const Time&) { return 0; }
+
+inline std::size_t heap_bytes(const ProfilePareto& profile) { return profile.size() * sizeof(ProfilePareto::pair_t); }
+
+inline std::size_t heap_bytes(const std::shared_ptr<const std::vector<Time>>& times) {
+    return times->size() * sizeof(Time);
+}
+
+
+// A bounded cache evicting with the CLOCK algorithm, an approximation of LRU in which a hit only
+// sets a flag instead of moving the entry. The keys are spread over shards with their own locks,
+// so that concurrent queries rarely wait for each other. Each entry is tagged with a generation,
+// and only the lookups of the same generation hit it.
+template<class Key, class Value, class Hash = std::hash<Key>>
+class ClockCache {
+private:
+    struct Slot {
+        Key key;
+        Value value;
+        uint64_t generation;
+        bool referenced;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Slot> slots;
+        std::unordered_map<Key, std::size_t, Hash> index;
+        std::size_t hand = 0;
+        std::size_t bytes = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::size_t _shard_capacity;
+    Hash _hash;
+
+    std::atomic<uint64_t> _hits {0};
+    std::atomic<uint64_t> _misses {0};
+
+    Shard& shard(const Key& key) {
+        return *_shards[_hash(key) % _shards.size()];
+    }
+
+public:
+    explicit ClockCache(const std::size_t& capacity, const std::size_t& n_shards = 16) :
+            _shard_capacity {std::max<std::size_t>(capacity / n_shards, 1)} {
+        for (std::size_t i = 0; i < n_shards; ++i) {
+            _shards.emplace_back(new Shard);
+        }
+    }
+
+    bool find(const Key& key, const uint64_t& generation, Value& value) {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock {s.mutex};
+
+        auto it = s.index.find(key);
+
+        if (it == s.index.end() || s.slots[it->second].generation != generation) {
+            ++_misses;
+            return false;
+        }
+
+        Slot& slot = s.slots[it->second];
+        slot.referenced = true;
+        value = slot.value;
+        ++_hits;
+
+        return true;
+    }
+
+    void insert(const Key& key, const Value& value, const uint64_t& generation) {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock {s.mutex};
+
+        auto it = s.index.find(key);
+        std::size_t position;
+
+        if (it != s.index.end()) {
+            position = it->second;
+            s.bytes -= heap_bytes(s.slots[position].value);
+        } else if (s.slots.size() < _shard_capacity) {
+            position = s.slots.size();
+            s.slots.push_back({key, value, generation, false});
+            s.index[key] = position;
+        } else {
+            // Advance the hand, giving a second chance to the entries hit since its last pass
+            while (s.slots[s.hand].referenced) {
+                s.slots[s.hand].referenced = false;
+                s.hand = (s.hand + 1) % s.slots.size();
+            }
+
+            position = s.hand;
+            s.hand = (s.hand + 1) % s.slots.size();
+
+            s.bytes -= heap_bytes(s.slots[position].value);
+            s.index.erase(s.slots[position].key);
+            s.index[key] = position;
+        }
+
+        s.slots[position] = {key, value, generation, false};
+        s.bytes += heap_bytes(value);
+    }
+
+    uint64_t hits() const { return _hits; }
+
+    uint64_t misses() const { return _misses; }
+
+    std::size_t size() {
+        std::size_t total = 0;
+
+        for (auto& s: _shards) {
+            std::lock_guard<std::mutex> lock {s->mutex};
+            total += s->slots.size();
+        }
+
+        return total;
+    }
+
+    // An estimate of the memory used by the entries, counting the values, the slots and the index
+    std::size_t memory() {
+        std::size_t total = 0;
+
+        for (auto& s: _shards) {
+            std::lock_guard<std::mutex> lock {s->mutex};
+            total += s->bytes + s->slots.capacity() * sizeof(Slot) +
+                     s->index.size() * (sizeof(Key) + sizeof(std::size_t) + 2 * sizeof(void*)) +
+                     s->index.bucket_count() * sizeof(void*);
+        }
+
+        return total;
+    }
+};
+
+
+// Print the statistics of a cache, if it was used
+void report_cache(const std::string& cache_name, const uint64_t& hits, const uint64_t& misses,
+                  const std::size_t& size, const std::size_t& memory);
+
+
+struct QueryKey {
+    NodeID source_id;
+    NodeID target_id;
+    Time departure_bucket;
+    uint32_t mode;
+
+    bool operator==(const QueryKey& other) const {
+        return source_id == other.source_id && target_id == other.target_id &&
+               departure_bucket == other.departure_bucket && mode == other.mode;
+    }
+};
+
+
+struct QueryKeyHash {
+    std::size_t operator()(const QueryKey& key) const {
+        uint64_t h = (static_cast<uint64_t>(key.source_id) << 32 | key.target_id) * 0x9E3779B97F4A7C15ULL;
+        h ^= (static_cast<uint64_t>(key.departure_bucket) << 2 | key.mode) + (h >> 29);
+        return static_cast<std::size_t>(h * 0xBF58476D1CE4E5B9ULL);
+    }
+};
+
+
+// Caches the results of the queries in front of ConnectionScan. The earliest arrival times are
+// cached by departure bucket, a hit returns the arrival time of the first query of its bucket,
+// thus the results are exact when the departure times are multiples of the bucket width.
+// The profiles are cached by source and target, and with profile_backed, an earliest arrival
+// query is answered from the profile of its source and target for any departure time. The answer is
+// the same as the one of the query when the transfers are transitively closed, or with --hl when the hub
+// labels give the shortest walking times. The profiles then also start with a walk to an out-hub of the source.
+// The entries are only valid for the generation of the snapshot they were computed on, which is the same
+// on all the NUMA nodes.
+class QueryCache {
+private:
+    ClockCache<QueryKey, Time, QueryKeyHash> _arrival_times;
+    ClockCache<QueryKey, ProfilePareto, QueryKeyHash> _profiles;
+    const Time _bucket_width;
+    const bool _profile_backed;
+
+    QueryKey key(const NodeID& source_id, const NodeID& target_id, const Time& departure_bucket, const bool& is_profile);
+
+public:
+    QueryCache(const std::size_t& capacity, const Time& bucket_width, const bool& profile_backed) :
+            _arrival_times {capacity}, _profiles {capacity},
+            _bucket_width {std::max<Time>(bucket_width, 1)}, _profile_backed {profile_backed} {};
+
+    // The queries must be run between csa.init() and csa.clear(), with the internal ids of the stops
+    Time query(ConnectionScan& csa, const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+
+    ProfilePareto profile_query(ConnectionScan& csa, const NodeID& source_id, const NodeID& target_id);
+
+    void report();
+};
+
+#endif // QUERY_CACHE_HPP
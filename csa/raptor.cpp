@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <map>
+
+#include "config.hpp"
+#include "raptor.hpp"
+
+
+RaptorTimetable::RaptorTimetable(std::shared_ptr<const Timetable> timetable) : _timetable {std::move(timetable)} {
+    const auto& connections = _timetable->connections;
+
+    // Group the trips by their sequences of stops, using the connections of each trip in order
+    std::map<std::vector<NodeID>, std::vector<TripID>> trips_by_stops;
+
+    for (TripID trip_id = 0; trip_id <= _timetable->max_trip_id; ++trip_id) {
+        const auto& trip = _timetable->trip_connections(trip_id);
+
+        if (trip.size() == 0) continue;
+
+        std::vector<NodeID> stops;
+
+        for (const auto& i: trip) {
+            stops.push_back(connections[i].departure_stop_id);
+        }
+
+        stops.push_back(connections[*(trip.end() - 1)].arrival_stop_id);
+        trips_by_stops[stops].push_back(trip_id);
+    }
+
+    // The times of a trip at the stops of its route, a trip arrives at its first stop at its departure
+    // and leaves its last stop at its arrival
+    auto trip_times = [&](const TripID& trip_id) {
+        const auto& trip = _timetable->trip_connections(trip_id);
+        std::vector<RouteStopTime> times;
+
+        for (const auto& i: trip) {
+            const auto& conn = connections[i];
+
+            if (times.empty()) times.push_back({conn.departure_time, conn.departure_time});
+
+            times.back().departure_time = conn.departure_time;
+            times.push_back({conn.arrival_time, conn.arrival_time});
+        }
+
+        return times;
+    };
+
+    for (auto& entry: trips_by_stops) {
+        const auto& stops = entry.first;
+        std::vector<std::vector<RouteStopTime>> trips;
+
+        for (const auto& trip_id: entry.second) {
+            trips.push_back(trip_times(trip_id));
+        }
+
+        std::sort(trips.begin(), trips.end(), [](const std::vector<RouteStopTime>& trip1,
+                                                 const std::vector<RouteStopTime>& trip2) {
+            return trip1.front().departure_time < trip2.front().departure_time;
+        });
+
+        // Each trip joins the first route whose last trip it does not overtake
+        std::vector<std::vector<std::vector<RouteStopTime>*>> split_routes;
+
+        for (auto& trip: trips) {
+            auto overtakes = [&](const std::vector<RouteStopTime>* last) {
+                for (std::size_t i = 0; i < stops.size(); ++i) {
+                    if (trip[i].arrival_time < (*last)[i].arrival_time ||
+                        trip[i].departure_time < (*last)[i].departure_time) {
+                        return true;
+                    }
+                }
+
+                return false;
+            };
+
+            auto route = std::find_if(split_routes.begin(), split_routes.end(),
+                                      [&](const std::vector<std::vector<RouteStopTime>*>& route_trips) {
+                                          return !overtakes(route_trips.back());
+                                      });
+
+            if (route == split_routes.end()) {
+                split_routes.emplace_back();
+                route = split_routes.end() - 1;
+            }
+
+            route->push_back(&trip);
+        }
+
+        for (const auto& route_trips: split_routes) {
+            routes.push_back({static_cast<uint32_t>(route_stops.size()), static_cast<uint32_t>(stops.size()),
+                              stop_times.size(), static_cast<uint32_t>(route_trips.size())});
+
+            route_stops.insert(route_stops.end(), stops.begin(), stops.end());
+
+            for (const auto& trip: route_trips) {
+                stop_times.insert(stop_times.end(), trip->begin(), trip->end());
+            }
+        }
+    }
+
+    // The routes serving each stop, the last stop of a route is skipped since no trip can be boarded there
+    stop_route_offsets.assign(_timetable->max_node_id + 2, 0);
+
+    for (const auto& route: routes) {
+        for (uint32_t i = 0; i + 1 < route.n_stops; ++i) {
+            ++stop_route_offsets[route_stops[route.first_stop + i] + 1];
+        }
+    }
+
+    for (std::size_t i = 1; i < stop_route_offsets.size(); ++i) {
+        stop_route_offsets[i] += stop_route_offsets[i - 1];
+    }
+
+    std::vector<uint64_t> stop_route_ends(stop_route_offsets.begin(), stop_route_offsets.end() - 1);
+    stop_routes.resize(stop_route_offsets.back());
+
+    for (uint32_t route_id = 0; route_id < routes.size(); ++route_id) {
+        const auto& route = routes[route_id];
+
+        for (uint32_t i = 0; i + 1 < route.n_stops; ++i) {
+            stop_routes[stop_route_ends[route_stops[route.first_stop + i]]++] = {route_id, i};
+        }
+    }
+
+    if (!use_hl) return;
+
+    // Invert the in-hubs, so that only the stops behind the improved hubs are updated after each round
+    hub_stop_offsets.assign(_timetable->max_node_id + 2, 0);
+
+    for (const auto& stop: _timetable->stops) {
+        for (const auto& hub_link: _timetable->in_hubs(stop.id)) {
+            ++hub_stop_offsets[hub_link.hub_id + 1];
+        }
+    }
+
+    for (std::size_t i = 1; i < hub_stop_offsets.size(); ++i) {
+        hub_stop_offsets[i] += hub_stop_offsets[i - 1];
+    }
+
+    std::vector<uint64_t> hub_stop_ends(hub_stop_offsets.begin(), hub_stop_offsets.end() - 1);
+    hub_stops.resize(hub_stop_offsets.back(), {0, 0, 0});
+
+    for (const auto& stop: _timetable->stops) {
+        for (const auto& hub_link: _timetable->in_hubs(stop.id)) {
+            hub_stops[hub_stop_ends[hub_link.hub_id]++] = {stop.id, hub_link.hub_id, hub_link.time};
+        }
+    }
+}
+
+
+// The trips are sorted by departure time at every stop
+uint32_t RaptorTimetable::earliest_trip(const Route& route, const uint32_t& stop_index, const Time& time,
+                                        const uint32_t& before_trip) const {
+    uint32_t first = 0;
+    uint32_t last = before_trip;
+
+    while (first < last) {
+        uint32_t middle = first + (last - first) / 2;
+
+        if (stop_time(route, middle, stop_index).departure_time < time) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+
+    return first;
+}
+
+
+Raptor::Raptor(std::shared_ptr<const RaptorTimetable> routes) :
+        _routes {std::move(routes)}, _timetable {&_routes->timetable()} {
+    earliest_arrival_time.assign(_timetable->max_node_id + 1, INF);
+    is_marked.assign(_timetable->max_node_id + 1, false);
+    route_start.assign(_routes->routes.size(), UINT32_MAX);
+}
+
+
+void Raptor::mark(const NodeID& stop_id) {
+    if (!is_marked[stop_id]) {
+        is_marked[stop_id] = true;
+        marked_stops.push_back(stop_id);
+    }
+}
+
+
+Time Raptor::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time) {
+    std::fill(earliest_arrival_time.begin(), earliest_arrival_time.end(), INF);
+
+    // Walk from the source, the same way as the connection scan
+    if (!use_hl) {
+        for (const auto& transfer: _timetable->transfers(source_id)) {
+            Time tmp_time = departure_time + transfer.time;
+
+            if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+                earliest_arrival_time[transfer.target_id] = tmp_time;
+                mark(transfer.target_id);
+            }
+        }
+    } else {
+        for (const auto& hub_link: _timetable->out_hubs(source_id)) {
+            Time tmp_time = departure_time + hub_link.time;
+
+            if (tmp_time < earliest_arrival_time[hub_link.hub_id]) {
+                earliest_arrival_time[hub_link.hub_id] = tmp_time;
+                improved_hubs.push_back(hub_link.hub_id);
+                mark(hub_link.hub_id);
+            }
+        }
+
+        walk_from_hubs();
+    }
+
+    while (!marked_stops.empty()) {
+        // Each route is scanned from the first of its stops marked in the previous round
+        for (const auto& stop_id: marked_stops) {
+            is_marked[stop_id] = false;
+
+            for (auto k = _routes->stop_route_offsets[stop_id]; k < _routes->stop_route_offsets[stop_id + 1]; ++k) {
+                const auto& route_id = _routes->stop_routes[k].first;
+                const auto& stop_index = _routes->stop_routes[k].second;
+
+                if (route_start[route_id] == UINT32_MAX) {
+                    queued_routes.push_back(route_id);
+                }
+
+                route_start[route_id] = std::min(route_start[route_id], stop_index);
+            }
+        }
+
+        marked_stops.clear();
+
+        for (const auto& route_id: queued_routes) {
+            scan_route(route_id, target_id);
+            route_start[route_id] = UINT32_MAX;
+        }
+
+        queued_routes.clear();
+
+        walk(target_id);
+    }
+
+    return earliest_arrival_time[target_id];
+}
+
+
+// Ride the route from its first marked stop, hopping on the earliest trip which can be caught at each stop
+void Raptor::scan_route(const uint32_t& route_id, const NodeID& target_id) {
+    const auto& route = _routes->routes[route_id];
+    const NodeID* stops = _routes->route_stops.data() + route.first_stop;
+
+    // The current trip, none while it is n_trips
+    uint32_t trip = route.n_trips;
+
+    for (uint32_t i = route_start[route_id]; i < route.n_stops; ++i) {
+        const auto& stop_id = stops[i];
+
+        if (trip < route.n_trips) {
+            const auto& arrival_time = _routes->stop_time(route, trip, i).arrival_time;
+
+            // An arrival not before the one at the target cannot lead to a better journey
+            if (arrival_time < std::min(earliest_arrival_time[stop_id], earliest_arrival_time[target_id])) {
+                earliest_arrival_time[stop_id] = arrival_time;
+                improved_stops.emplace_back(stop_id, arrival_time);
+                mark(stop_id);
+            }
+        }
+
+        const auto& ready_time = earliest_arrival_time[stop_id];
+
+        if (i + 1 == route.n_stops || ready_time == INF ||
+            (trip < route.n_trips && ready_time > _routes->stop_time(route, trip, i).departure_time)) {
+            continue;
+        }
+
+        trip = _routes->earliest_trip(route, i, ready_time, trip);
+    }
+}
+
+
+// Walk from the stops improved by the trips, the transfers and the out-hubs are sorted by walking time,
+// so the walks stop as soon as they arrive after the target
+void Raptor::walk(const NodeID& target_id) {
+    for (const auto& improved: improved_stops) {
+        const auto& stop_id = improved.first;
+        const auto& arrival_time = improved.second;
+
+        if (!use_hl) {
+            for (const auto& transfer: _timetable->transfers(stop_id)) {
+                Time tmp_time = arrival_time + transfer.time;
+
+                if (tmp_time > earliest_arrival_time[target_id]) break;
+
+                if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+                    earliest_arrival_time[transfer.target_id] = tmp_time;
+                    mark(transfer.target_id);
+                }
+            }
+        } else {
+            // A stop can be the hub of other stops
+            improved_hubs.push_back(stop_id);
+
+            for (const auto& hub_link: _timetable->out_hubs(stop_id)) {
+                Time tmp_time = arrival_time + hub_link.time;
+
+                if (tmp_time > earliest_arrival_time[target_id]) break;
+
+                if (tmp_time < earliest_arrival_time[hub_link.hub_id]) {
+                    earliest_arrival_time[hub_link.hub_id] = tmp_time;
+                    improved_hubs.push_back(hub_link.hub_id);
+                    mark(hub_link.hub_id);
+                }
+            }
+        }
+    }
+
+    improved_stops.clear();
+
+    if (use_hl) {
+        walk_from_hubs();
+    }
+}
+
+
+// Walk from the improved hubs to the stops having them as in-hubs
+void Raptor::walk_from_hubs() {
+    for (const auto& hub_id: improved_hubs) {
+        for (auto k = _routes->hub_stop_offsets[hub_id]; k < _routes->hub_stop_offsets[hub_id + 1]; ++k) {
+            const auto& hub_link = _routes->hub_stops[k];
+            Time tmp_time = earliest_arrival_time[hub_id] + hub_link.time;
+
+            if (tmp_time < earliest_arrival_time[hub_link.stop_id]) {
+                earliest_arrival_time[hub_link.stop_id] = tmp_time;
+                mark(hub_link.stop_id);
+            }
+        }
+    }
+
+    improved_hubs.clear();
+}
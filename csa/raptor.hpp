@@ -0,0 +1,108 @@
+#ifndef RAPTOR_HPP
+#define RAPTOR_HPP
+
+#include <memory>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+struct RouteStopTime {
+    Time arrival_time;
+    Time departure_time;
+};
+
+
+// The trips of a route visit the same sequence of stops without overtaking each other,
+// and they are sorted by their departure times, which are thus sorted at every stop
+struct Route {
+    uint32_t first_stop;
+    uint32_t n_stops;
+    uint64_t first_stop_time;
+    uint32_t n_trips;
+};
+
+
+// The routes of a timetable, derived from its trips. The trips with the same sequence of stops
+// form a route, which is split further if a trip overtakes another one.
+class RaptorTimetable {
+private:
+    std::shared_ptr<const Timetable> _timetable;
+
+public:
+    std::vector<Route> routes;
+
+    // The stops of each route in order
+    std::vector<NodeID> route_stops;
+
+    // The times of the trips of each route, trip by trip, the time of the trip j at the stop i
+    // of the route r is at r.first_stop_time + j * r.n_stops + i
+    std::vector<RouteStopTime> stop_times;
+
+    // The routes serving each stop with the index of the stop in the route, the routes of the stop s
+    // are between the offsets stop_route_offsets[s] and stop_route_offsets[s + 1]
+    std::vector<uint64_t> stop_route_offsets;
+    std::vector<std::pair<uint32_t, uint32_t>> stop_routes;
+
+    // The stops having each node as an in-hub, the links of the hub h are between the offsets
+    // hub_stop_offsets[h] and hub_stop_offsets[h + 1], only with --hl
+    std::vector<uint64_t> hub_stop_offsets;
+    std::vector<HubLink> hub_stops;
+
+    explicit RaptorTimetable(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _timetable; }
+
+    const Timetable& timetable() const { return *_timetable; }
+
+    const RouteStopTime& stop_time(const Route& route, const uint32_t& trip, const uint32_t& stop_index) const {
+        return stop_times[route.first_stop_time + static_cast<uint64_t>(trip) * route.n_stops + stop_index];
+    }
+
+    // The first trip of the route among those before the given one departing from the stop not before the time,
+    // or the given trip if there is none
+    uint32_t earliest_trip(const Route& route, const uint32_t& stop_index, const Time& time,
+                           const uint32_t& before_trip) const;
+};
+
+
+// The round-based public transit routing algorithm. Each round scans the routes serving
+// the stops improved in the previous round, then walks from the stops improved by the routes.
+// The footpaths follow the same rules as ConnectionScan, so that both compute the same arrival times.
+class Raptor {
+private:
+    std::shared_ptr<const RaptorTimetable> _routes;
+    const Timetable* _timetable;
+
+    std::vector<Time> earliest_arrival_time;
+
+    // The stops improved since their routes were last scanned
+    std::vector<NodeID> marked_stops;
+    std::vector<bool> is_marked;
+
+    // The first stop index to scan in each route in the current round
+    std::vector<uint32_t> route_start;
+    std::vector<uint32_t> queued_routes;
+
+    // The stops improved by the trips in the current round with their arrival times,
+    // and the hubs improved by walking from them
+    std::vector<std::pair<NodeID, Time>> improved_stops;
+    std::vector<NodeID> improved_hubs;
+
+    void mark(const NodeID& stop_id);
+
+    void scan_route(const uint32_t& route_id, const NodeID& target_id);
+
+    void walk(const NodeID& target_id);
+
+    void walk_from_hubs();
+
+public:
+    explicit Raptor(std::shared_ptr<const RaptorTimetable> routes);
+
+    const std::shared_ptr<const RaptorTimetable>& routes() const { return _routes; }
+
+    Time query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+};
+
+#endif // RAPTOR_HPP
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <iostream>
+
+#include "config.hpp"
+#include "realtime.hpp"
+
+
+// Shift a time by a delay, without going before the start of the day
+static Time shift(const Time& time, const int& delay) {
+    if (delay < 0 && static_cast<Time>(-delay) > time) {
+        return 0;
+    }
+
+    return static_cast<Time>(static_cast<int64_t>(time) + delay);
+}
+
+
+// Whether the trip with the given original id is in the timetable
+static bool has_trip(const Timetable& timetable, const TripID& original_id) {
+    if (!timetable.internal_trip_ids.empty() && original_id >= timetable.internal_trip_ids.size()) return false;
+
+    return timetable.internal_trip_id(original_id) <= timetable.max_trip_id;
+}
+
+
+DelayUpdater::DelayUpdater(TimetableStore& store) : _store {store}, _schedule {store.acquire()} {
+    if (prune) {
+        std::cerr << "Error occurred while setting up the delays: a pruned timetable cannot be delayed" << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        exit(1);
+    }
+
+    _store.on_reload([this](const std::shared_ptr<const Timetable>& timetable) {
+        _schedule = timetable;
+
+        std::vector<TripID> trip_ids;
+
+        for (const auto& delays: _delays) {
+            trip_ids.push_back(delays.first);
+        }
+
+        auto delayed = delayed_timetable(timetable, trip_ids);
+
+        return delayed ? delayed : timetable;
+    });
+}
+
+
+DelayUpdater::~DelayUpdater() {
+    _store.on_reload(nullptr);
+}
+
+
+void DelayUpdater::apply(const std::vector<DelayEvent>& events) {
+    _store.update([&](const std::shared_ptr<const Timetable>& current) {
+        std::vector<TripID> trip_ids;
+
+        for (const auto& event: events) {
+            // Ignore the events of the trips which are not in the timetable
+            if (!has_trip(*_schedule, event.trip_id)) continue;
+
+            _delays[event.trip_id][event.stop_sequence] = event.delay;
+            trip_ids.push_back(event.trip_id);
+        }
+
+        return delayed_timetable(current, trip_ids);
+    });
+}
+
+
+// The current timetable with the connections of the given trips retimed, nullptr if there is no trip. The new
+// timetable shares the arrays of the current one, except for the connections and the indexes built from them.
+std::shared_ptr<const Timetable> DelayUpdater::delayed_timetable(const std::shared_ptr<const Timetable>& current,
+                                                                 const std::vector<TripID>& trip_ids) const {
+    if (trip_ids.empty()) return nullptr;
+
+    std::vector<TripID> unique_ids {trip_ids};
+    std::sort(unique_ids.begin(), unique_ids.end());
+    unique_ids.erase(std::unique(unique_ids.begin(), unique_ids.end()), unique_ids.end());
+
+    auto next = std::make_shared<Timetable>(current);
+    next->retime_connections(delayed_connections(unique_ids));
+
+    return next;
+}
+
+
+// The connections of the given trips with their current delays applied to the scheduled times
+std::vector<Connection> DelayUpdater::delayed_connections(const std::vector<TripID>& trip_ids) const {
+    std::vector<Connection> result;
+
+    for (const auto& original_id: trip_ids) {
+        if (!has_trip(*_schedule, original_id)) continue;
+
+        const auto& delays = _delays.at(original_id);
+
+        // The delay at a stop is the one of the last event not after the stop
+        auto delay_at = [&](const int& stop_sequence) {
+            auto iter = delays.upper_bound(stop_sequence);
+            return iter == delays.begin() ? 0 : std::prev(iter)->second;
+        };
+
+        // The scheduled connections of the trip in the order of the trip, read from the trip index
+        auto trip = _schedule->trip_connections(_schedule->internal_trip_id(original_id));
+
+        Time previous_arrival = 0;
+
+        for (auto iter = trip.begin(); iter != trip.end(); ++iter) {
+            const Connection& conn = _schedule->connections[*iter];
+
+            // The arrival stop of the connection is the departure stop of the next one in the trip. The sequence
+            // of the last stop is not kept in the connections, it is taken to follow the one of the last departure.
+            int arrival_sequence = iter + 1 != trip.end() ? _schedule->connections[*(iter + 1)].stop_sequence :
+                                   conn.stop_sequence + 1;
+
+            // A vehicle cannot leave a stop before arriving there, nor arrive before leaving
+            Time departure_time = std::max(shift(conn.departure_time, delay_at(conn.stop_sequence)), previous_arrival);
+            Time arrival_time = std::max(shift(conn.arrival_time, delay_at(arrival_sequence)), departure_time);
+            previous_arrival = arrival_time;
+
+            result.emplace_back(conn.trip_id, conn.departure_stop_id, conn.arrival_stop_id,
+                                departure_time, arrival_time, conn.stop_sequence);
+        }
+    }
+
+    return result;
+}
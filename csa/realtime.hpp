@@ -0,0 +1,61 @@
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "data_structure.hpp"
+#include "timetable_store.hpp"
+
+
+// A delay of a trip from the given stop on, relative to its scheduled times. The delay applies
+// to the arrival at and the departure from the stop, and to all the later stops of the trip
+// until the next delay event of the trip. The ids are the original ids of the dataset.
+struct DelayEvent {
+    TripID trip_id;
+    int stop_sequence;
+    int delay;
+
+    DelayEvent(TripID tid, int seq, int d) : trip_id {tid}, stop_sequence {seq}, delay {d} {};
+};
+
+
+// Applies batches of delay events to the timetable held by a store. Each batch produces a new
+// snapshot, in which only the connections of the delayed trips are recomputed from the schedule
+// and moved to their new place in the departure order, and the snapshot is then published to the store.
+// The batches and the reloads of the store are published one at a time, and a reloaded timetable
+// becomes the new schedule, to which all the current delays are applied again before it is published.
+// The queries running on the previous snapshot are never blocked.
+class DelayUpdater {
+private:
+    TimetableStore& _store;
+
+    // The scheduled timetable, which the delays are relative to, only accessed by the functions
+    // called by the store
+    std::shared_ptr<const Timetable> _schedule;
+
+    // The current delays of each trip indexed by the stop sequence where they start, the trips
+    // are given by their original ids, which do not change with a reload
+    std::unordered_map<TripID, std::map<int, int>> _delays;
+
+    std::shared_ptr<const Timetable> delayed_timetable(const std::shared_ptr<const Timetable>& current,
+                                                       const std::vector<TripID>& trip_ids) const;
+
+    std::vector<Connection> delayed_connections(const std::vector<TripID>& trip_ids) const;
+
+public:
+    // The connections of a pruned timetable are not all in their trips, thus it cannot be delayed
+    explicit DelayUpdater(TimetableStore& store);
+
+    DelayUpdater(const DelayUpdater&) = delete;
+
+    DelayUpdater& operator=(const DelayUpdater&) = delete;
+
+    ~DelayUpdater();
+
+    void apply(const std::vector<DelayEvent>& events);
+};
+
+#endif // REALTIME_HPP
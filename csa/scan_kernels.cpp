@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CSA_AVX2_KERNEL
+#endif
+
+#include "config.hpp"
+#include "scan_kernels.hpp"
+
+
+// The number of connections tested at once by the block kernel
+static const std::size_t block_size = 16;
+
+
+ConnectionColumns::ConnectionColumns(std::shared_ptr<const Timetable> timetable) :
+        _timetable {std::move(timetable)} {
+    const auto& connections = _timetable->connections;
+
+    departure_times.reserve(connections.size());
+    arrival_times.reserve(connections.size());
+    departure_stop_ids.reserve(connections.size());
+    arrival_stop_ids.reserve(connections.size());
+    trip_ids.reserve(connections.size());
+
+    for (const auto& conn: connections) {
+        departure_times.push_back(conn.departure_time);
+        arrival_times.push_back(conn.arrival_time);
+        departure_stop_ids.push_back(conn.departure_stop_id);
+        arrival_stop_ids.push_back(conn.arrival_stop_id);
+        trip_ids.push_back(conn.trip_id);
+    }
+}
+
+
+// The bits of the connections of a block whose trip is reached or whose departure stop is reached in time
+static uint32_t block_mask_generic(const ConnectionColumns& columns, const std::size_t& first,
+                                   const Time* earliest_arrival_time, const uint32_t* trip_reached) {
+    uint32_t mask = 0;
+
+    for (std::size_t k = 0; k < block_size; ++k) {
+        const auto& trip_id = columns.trip_ids[first + k];
+        bool passes = ((trip_reached[trip_id >> 5] >> (trip_id & 31)) & 1) != 0 ||
+                      earliest_arrival_time[columns.departure_stop_ids[first + k]] <= columns.departure_times[first + k];
+
+        mask |= static_cast<uint32_t>(passes) << k;
+    }
+
+    return mask;
+}
+
+
+#ifdef CSA_AVX2_KERNEL
+
+// The same test on 8 connections at a time, with the earliest arrival times and the words of the trip bitmap
+// gathered by the indices loaded from the columns. The times are below 2^31, thus compared as signed integers.
+__attribute__((target("avx2")))
+static uint32_t block_mask_avx2(const ConnectionColumns& columns, const std::size_t& first,
+                                const Time* earliest_arrival_time, const uint32_t* trip_reached) {
+    const auto* ea = reinterpret_cast<const int*>(earliest_arrival_time);
+    const auto* bits = reinterpret_cast<const int*>(trip_reached);
+    const __m256i low_bits = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    uint32_t mask = 0;
+
+    for (std::size_t k = 0; k < block_size; k += 8) {
+        const auto* dep_times = reinterpret_cast<const __m256i*>(columns.departure_times.data() + first + k);
+        const auto* dep_ids = reinterpret_cast<const __m256i*>(columns.departure_stop_ids.data() + first + k);
+        const auto* trip_ids = reinterpret_cast<const __m256i*>(columns.trip_ids.data() + first + k);
+
+        __m256i trips = _mm256_loadu_si256(trip_ids);
+        __m256i words = _mm256_i32gather_epi32(bits, _mm256_srli_epi32(trips, 5), 4);
+        __m256i reached = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(trips, low_bits)), one);
+        reached = _mm256_cmpeq_epi32(reached, one);
+
+        __m256i arrivals = _mm256_i32gather_epi32(ea, _mm256_loadu_si256(dep_ids), 4);
+        __m256i late = _mm256_cmpgt_epi32(arrivals, _mm256_loadu_si256(dep_times));
+
+        // A connection passes if its trip is reached or its departure stop is not reached too late
+        __m256i passes = _mm256_or_si256(reached, _mm256_xor_si256(late, _mm256_set1_epi32(-1)));
+
+        mask |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(passes))) << k;
+    }
+
+    return mask;
+}
+
+#endif
+
+
+using BlockMask = uint32_t (*)(const ConnectionColumns&, const std::size_t&, const Time*, const uint32_t*);
+
+// The AVX2 test is only used on the processors supporting it, the build does not assume any instruction set
+static BlockMask select_block_mask() {
+    #ifdef CSA_AVX2_KERNEL
+    if (__builtin_cpu_supports("avx2")) return block_mask_avx2;
+    #endif
+
+    return block_mask_generic;
+}
+
+
+static const BlockMask block_mask = select_block_mask();
+
+
+KernelScan::KernelScan(std::shared_ptr<const ConnectionColumns> columns, const std::size_t& prefetch_distance) :
+        _columns {std::move(columns)}, _timetable {&_columns->timetable()}, _prefetch_distance {prefetch_distance} {
+    earliest_arrival_time.assign(_timetable->max_node_id + 1, INF);
+    trip_reached.assign(_timetable->max_trip_id / 32 + 1, 0);
+}
+
+
+// Update the earliest arrival times of the out-neighbours of an improved stop, the same way as
+// ConnectionScan::update_out_hubs without hub labels
+void KernelScan::walk(const NodeID& arr_id, const Time& arrival_time, const NodeID& target_id) {
+    const Time target_time = earliest_arrival_time[target_id];
+
+    for (const auto& transfer: _timetable->transfers(arr_id)) {
+        Time tmp_time = arrival_time + transfer.time;
+
+        if (tmp_time > target_time) break;
+
+        if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+            earliest_arrival_time[transfer.target_id] = tmp_time;
+        }
+    }
+}
+
+
+// The relaxation of ConnectionScan::scan without hub labels
+void KernelScan::scan_connection(const std::size_t& i, const NodeID& target_id) {
+    const auto& trip_id = _columns->trip_ids[i];
+    auto& word = trip_reached[trip_id >> 5];
+    const uint32_t bit = 1u << (trip_id & 31);
+
+    if ((word & bit) == 0 && earliest_arrival_time[_columns->departure_stop_ids[i]] > _columns->departure_times[i]) {
+        return;
+    }
+
+    word |= bit;
+
+    const auto& arr_id = _columns->arrival_stop_ids[i];
+    const auto& arrival_time = _columns->arrival_times[i];
+
+    if (arrival_time < earliest_arrival_time[arr_id]) {
+        earliest_arrival_time[arr_id] = arrival_time;
+
+        walk(arr_id, arrival_time, target_id);
+    }
+}
+
+
+// The relaxation of scan_connection where the trip bitmap and the arrival time are always written,
+// so that only the rare walks from an improved stop are branched on
+void KernelScan::relax_connection(const std::size_t& i, const NodeID& target_id) {
+    const auto& trip_id = _columns->trip_ids[i];
+    auto& word = trip_reached[trip_id >> 5];
+    const uint32_t bit = 1u << (trip_id & 31);
+
+    const auto& arr_id = _columns->arrival_stop_ids[i];
+    const auto& arrival_time = _columns->arrival_times[i];
+    const Time previous_time = earliest_arrival_time[arr_id];
+
+    uint32_t reached = static_cast<uint32_t>((word & bit) != 0) |
+                       static_cast<uint32_t>(earliest_arrival_time[_columns->departure_stop_ids[i]] <=
+                                             _columns->departure_times[i]);
+    uint32_t improved = reached & static_cast<uint32_t>(arrival_time < previous_time);
+
+    word |= bit & (0u - reached);
+    earliest_arrival_time[arr_id] = improved ? arrival_time : previous_time;
+
+    if (improved) walk(arr_id, arrival_time, target_id);
+}
+
+
+// Scan the connections from the i-th one. The blocks without any connection passing the test are skipped,
+// otherwise the block is relaxed one connection at a time from the first one passing the test, since the later
+// connections of the block can pass after the relaxation of the earlier ones. The target pruning of
+// ConnectionScan is checked before each block and each relaxed connection.
+Time KernelScan::block_scan(std::size_t i, const NodeID& target_id) {
+    const auto n_connections = _columns->departure_times.size();
+    const auto& departure_times = _columns->departure_times;
+
+    for (; i + block_size <= n_connections; i += block_size) {
+        if (earliest_arrival_time[target_id] <= departure_times[i]) return earliest_arrival_time[target_id];
+
+        auto mask = block_mask(*_columns, i, earliest_arrival_time.data(), trip_reached.data());
+
+        if (mask == 0) continue;
+
+        for (auto j = i + __builtin_ctz(mask); j < i + block_size; ++j) {
+            if (earliest_arrival_time[target_id] <= departure_times[j]) return earliest_arrival_time[target_id];
+
+            scan_connection(j, target_id);
+        }
+    }
+
+    for (; i < n_connections; ++i) {
+        if (earliest_arrival_time[target_id] <= departure_times[i]) break;
+
+        scan_connection(i, target_id);
+    }
+
+    return earliest_arrival_time[target_id];
+}
+
+
+Time KernelScan::prefetch_scan(std::size_t i, const NodeID& target_id) {
+    const auto n_connections = _columns->departure_times.size();
+    const auto& departure_times = _columns->departure_times;
+    const auto& departure_stop_ids = _columns->departure_stop_ids;
+    const auto& arrival_stop_ids = _columns->arrival_stop_ids;
+    const auto& trip_ids = _columns->trip_ids;
+
+    for (; i < n_connections; ++i) {
+        if (earliest_arrival_time[target_id] <= departure_times[i]) break;
+
+        const auto ahead = i + _prefetch_distance;
+
+        if (_prefetch_distance > 0 && ahead < n_connections) {
+            __builtin_prefetch(&earliest_arrival_time[departure_stop_ids[ahead]]);
+            __builtin_prefetch(&earliest_arrival_time[arrival_stop_ids[ahead]], 1);
+            __builtin_prefetch(&trip_reached[trip_ids[ahead] >> 5], 1);
+        }
+
+        relax_connection(i, target_id);
+    }
+
+    return earliest_arrival_time[target_id];
+}
+
+
+Time KernelScan::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time) {
+    std::fill(earliest_arrival_time.begin(), earliest_arrival_time.end(), INF);
+
+    // The bitmap is cleared as a whole, its size is an eighth of the number of trips in bytes
+    std::memset(trip_reached.data(), 0, trip_reached.size() * sizeof(uint32_t));
+
+    for (const auto& transfer: _timetable->transfers(source_id)) {
+        Time tmp_time = departure_time + transfer.time;
+
+        if (tmp_time < earliest_arrival_time[transfer.target_id]) {
+            earliest_arrival_time[transfer.target_id] = tmp_time;
+        }
+    }
+
+    const auto& departure_times = _columns->departure_times;
+    auto first = std::lower_bound(departure_times.begin(), departure_times.end(), departure_time);
+
+    auto i = static_cast<std::size_t>(first - departure_times.begin());
+
+    return kernel == "block" ? block_scan(i, target_id) : prefetch_scan(i, target_id);
+}
@@ -0,0 +1,65 @@
+#ifndef SCAN_KERNELS_HPP
+#define SCAN_KERNELS_HPP
+
+#include <memory>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+// The columns of the connections of a timetable, in the order of the connections, so that a kernel
+// loads the same attribute of consecutive connections together
+class ConnectionColumns {
+private:
+    std::shared_ptr<const Timetable> _timetable;
+
+public:
+    std::vector<Time> departure_times;
+    std::vector<Time> arrival_times;
+    std::vector<NodeID> departure_stop_ids;
+    std::vector<NodeID> arrival_stop_ids;
+    std::vector<TripID> trip_ids;
+
+    explicit ConnectionColumns(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _timetable; }
+
+    const Timetable& timetable() const { return *_timetable; }
+};
+
+
+// The earliest arrival query of ConnectionScan without hub labels, with another loop over the connections.
+// The block kernel tests whether the trip of each connection is reached or its departure stop is reached
+// in time for a block of connections at once, and only relaxes the connections of the blocks with
+// a connection passing the test. The reached trips are kept in a plain bitmap, so that their bits can be
+// gathered along with the earliest arrival times.
+// The prefetch kernel relaxes every connection without branching on its outcome, and prefetches the state of
+// the stops and the trip of the connection the given distance ahead, no prefetch being issued with distance 0.
+class KernelScan {
+private:
+    std::shared_ptr<const ConnectionColumns> _columns;
+    const Timetable* _timetable;
+    std::size_t _prefetch_distance;
+
+    std::vector<Time> earliest_arrival_time;
+    std::vector<uint32_t> trip_reached;
+
+    inline void walk(const NodeID& arr_id, const Time& arrival_time, const NodeID& target_id);
+
+    inline void scan_connection(const std::size_t& i, const NodeID& target_id);
+
+    inline void relax_connection(const std::size_t& i, const NodeID& target_id);
+
+    Time block_scan(std::size_t i, const NodeID& target_id);
+
+    Time prefetch_scan(std::size_t i, const NodeID& target_id);
+
+public:
+    KernelScan(std::shared_ptr<const ConnectionColumns> columns, const std::size_t& prefetch_distance);
+
+    const std::shared_ptr<const ConnectionColumns>& columns() const { return _columns; }
+
+    Time query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+};
+
+#endif // SCAN_KERNELS_HPP
@@ -0,0 +1,253 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+
+#include "snapshot.hpp"
+
+
+// The layout of a snapshot: a header followed by the arrays of the timetable, each one starting
+// at an offset aligned to a cache line. The header records the size of the elements of each array,
+// so that a snapshot written by an incompatible build is rejected instead of being misread.
+static const char snapshot_magic[8] = {'C', 'S', 'A', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t snapshot_version = 6;
+static const uint64_t section_alignment = 64;
+
+enum Section : uint32_t {
+    CONNECTIONS,
+    STOPS,
+    TRANSFERS,
+    BACKWARD_TRANSFERS,
+    IN_HUBS,
+    OUT_HUBS,
+    ORIGINAL_STOP_IDS,
+    INTERNAL_STOP_IDS,
+    ORIGINAL_TRIP_IDS,
+    INTERNAL_TRIP_IDS,
+    ORIGINAL_HUB_IDS,
+    ARRIVAL_ORDER,
+    DEPARTURES,
+    TRIP_CONNECTIONS,
+    TRIP_OFFSETS,
+    N_SECTIONS
+};
+
+struct SectionEntry {
+    uint64_t offset;
+    uint64_t count;
+    uint64_t element_size;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t use_hl;
+    uint32_t pruned;
+    uint64_t max_node_id;
+    uint64_t max_trip_id;
+    SectionEntry sections[N_SECTIONS];
+};
+
+
+static void snapshot_error(const std::string& message) {
+    std::cerr << "Error occurred while " << message << std::endl;
+    std::cerr << "Exiting..." << std::endl;
+    exit(1);
+}
+
+
+template<class T>
+static void write_section(std::ostream& out, SnapshotHeader& header, const Section& section, const Array<T>& array) {
+    static_assert(std::is_trivially_copyable<T>::value, "The arrays of a snapshot must be trivially copyable");
+
+    auto offset = static_cast<uint64_t>(out.tellp());
+    auto padding = (section_alignment - offset % section_alignment) % section_alignment;
+
+    out << std::string(padding, '\0');
+    out.write(reinterpret_cast<const char*>(array.data()), static_cast<std::streamsize>(array.size() * sizeof(T)));
+
+    header.sections[section] = {offset + padding, array.size(), sizeof(T)};
+}
+
+
+template<class T>
+static Array<T> read_section(const SnapshotFile& file, const SnapshotHeader& header, const Section& section) {
+    const SectionEntry& entry = header.sections[section];
+
+    if (entry.element_size != sizeof(T) || entry.offset % alignof(T) != 0 ||
+        entry.offset + entry.count * sizeof(T) > file.size()) {
+        snapshot_error("reading the snapshot, the snapshot is corrupted or was written by another build");
+    }
+
+    return Array<T>::borrow(reinterpret_cast<const T*>(file.data() + entry.offset), entry.count);
+}
+
+
+void Timetable::save(const std::string& file_path) const {
+    std::ofstream out {file_path, std::ios::binary | std::ios::trunc};
+
+    if (!out) {
+        snapshot_error("writing " + file_path);
+    }
+
+    SnapshotHeader header {};
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version = snapshot_version;
+    header.use_hl = use_hl;
+    header.pruned = prune;
+    header.max_node_id = max_node_id;
+    header.max_trip_id = max_trip_id;
+
+    // The header is written again at the end, once the offsets of the sections are known
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    write_section(out, header, CONNECTIONS, connections);
+    write_section(out, header, STOPS, stops);
+    write_section(out, header, TRANSFERS, _transfers);
+    write_section(out, header, BACKWARD_TRANSFERS, _backward_transfers);
+    write_section(out, header, IN_HUBS, _in_hubs);
+    write_section(out, header, OUT_HUBS, _out_hubs);
+    write_section(out, header, ORIGINAL_STOP_IDS, original_stop_ids);
+    write_section(out, header, INTERNAL_STOP_IDS, internal_stop_ids);
+    write_section(out, header, ORIGINAL_TRIP_IDS, original_trip_ids);
+    write_section(out, header, INTERNAL_TRIP_IDS, internal_trip_ids);
+    write_section(out, header, ORIGINAL_HUB_IDS, original_hub_ids);
+    write_section(out, header, ARRIVAL_ORDER, arrival_order);
+    write_section(out, header, DEPARTURES, _departures);
+    write_section(out, header, TRIP_CONNECTIONS, _trip_connections);
+    write_section(out, header, TRIP_OFFSETS, _trip_offsets);
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!out) {
+        snapshot_error("writing " + file_path);
+    }
+}
+
+
+Timetable::Timetable(std::shared_ptr<const SnapshotFile> snapshot) : _snapshot {std::move(snapshot)} {
+    path = "../../Public-Transit-Data/" + name + "/";
+
+    SnapshotHeader header;
+
+    if (_snapshot->size() < sizeof(header)) {
+        snapshot_error("reading the snapshot, the file is too small");
+    }
+
+    std::memcpy(&header, _snapshot->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0 || header.version != snapshot_version) {
+        snapshot_error("reading the snapshot, the file is not a snapshot of this version");
+    }
+
+    // The snapshot only contains the footpaths of the walking mode it was created with
+    if (header.use_hl != static_cast<uint32_t>(use_hl)) {
+        snapshot_error("reading the snapshot, it was created with" + std::string(use_hl ? "out" : "") + " --hl");
+    }
+
+    if (header.pruned != static_cast<uint32_t>(prune)) {
+        snapshot_error("reading the snapshot, it was created with" + std::string(prune ? "out" : "") + " --prune");
+    }
+
+    max_node_id = header.max_node_id;
+    max_trip_id = header.max_trip_id;
+
+    connections = read_section<Connection>(*_snapshot, header, CONNECTIONS);
+    stops = read_section<Stop>(*_snapshot, header, STOPS);
+    _transfers = read_section<Transfer>(*_snapshot, header, TRANSFERS);
+    _backward_transfers = read_section<Transfer>(*_snapshot, header, BACKWARD_TRANSFERS);
+    _in_hubs = read_section<uint32_t>(*_snapshot, header, IN_HUBS);
+    _out_hubs = read_section<uint32_t>(*_snapshot, header, OUT_HUBS);
+    original_stop_ids = read_section<NodeID>(*_snapshot, header, ORIGINAL_STOP_IDS);
+    internal_stop_ids = read_section<NodeID>(*_snapshot, header, INTERNAL_STOP_IDS);
+    original_trip_ids = read_section<TripID>(*_snapshot, header, ORIGINAL_TRIP_IDS);
+    internal_trip_ids = read_section<TripID>(*_snapshot, header, INTERNAL_TRIP_IDS);
+    original_hub_ids = read_section<NodeID>(*_snapshot, header, ORIGINAL_HUB_IDS);
+    arrival_order = read_section<ConnectionID>(*_snapshot, header, ARRIVAL_ORDER);
+    _departures = read_section<ConnectionID>(*_snapshot, header, DEPARTURES);
+    _trip_connections = read_section<ConnectionID>(*_snapshot, header, TRIP_CONNECTIONS);
+    _trip_offsets = read_section<ConnectionID>(*_snapshot, header, TRIP_OFFSETS);
+}
+
+
+SnapshotFile::SnapshotFile(const std::string& file_path) : _data {nullptr}, _size {0} {
+    int fd = open(file_path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        snapshot_error("opening " + file_path);
+    }
+
+    map(fd, file_path);
+    close(fd);
+}
+
+
+SnapshotFile::SnapshotFile(int fd) : _data {nullptr}, _size {0} {
+    map(fd, "file descriptor " + std::to_string(fd));
+}
+
+
+void SnapshotFile::map(int fd, const std::string& description) {
+    struct stat file_stat {};
+
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+        snapshot_error("reading the size of " + description);
+    }
+
+    _size = static_cast<std::size_t>(file_stat.st_size);
+
+    // The mapping is read-only and shared, thus backed by the same physical pages in every process
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (data == MAP_FAILED) {
+        snapshot_error("mapping " + description);
+    }
+
+    _data = static_cast<const char*>(data);
+}
+
+
+SnapshotFile::~SnapshotFile() {
+    munmap(const_cast<char*>(_data), _size);
+}
+
+
+int create_snapshot_memfd(const Timetable& timetable) {
+    int fd = memfd_create("csa_timetable", 0);
+
+    if (fd < 0) {
+        snapshot_error("creating the memory file of the snapshot");
+    }
+
+    timetable.save("/proc/self/fd/" + std::to_string(fd));
+
+    return fd;
+}
+
+
+std::shared_ptr<const Timetable> load_shared_timetable(const std::string& file_path) {
+    if (!std::ifstream {file_path}) {
+        std::cout << "Creating the snapshot " << file_path << std::endl;
+
+        // Write to a temporary file first, so that other processes never map a partial snapshot
+        std::string tmp_path = file_path + ".tmp" + std::to_string(getpid());
+        Timetable {}.save(tmp_path);
+
+        if (std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+            snapshot_error("renaming " + tmp_path);
+        }
+    }
+
+    Timer timer;
+
+    auto timetable = std::make_shared<const Timetable>(std::make_shared<const SnapshotFile>(file_path));
+
+    std::cout << "Mapped the snapshot " << file_path << " in " << timer.elapsed() << timer.unit() << std::endl;
+
+    return timetable;
+}
@@ -0,0 +1,45 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+
+#include "data_structure.hpp"
+
+
+// A read-only shared mapping of a binary snapshot of a timetable. All the processes mapping
+// the same file share a single physical copy of the timetable through the page cache.
+class SnapshotFile {
+private:
+    const char* _data;
+    std::size_t _size;
+
+    void map(int fd, const std::string& description);
+
+public:
+    explicit SnapshotFile(const std::string& file_path);
+
+    // Map an already opened file, e.g. a memfd inherited from the parent process
+    explicit SnapshotFile(int fd);
+
+    SnapshotFile(const SnapshotFile&) = delete;
+
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    ~SnapshotFile();
+
+    const char* data() const { return _data; }
+
+    std::size_t size() const { return _size; }
+};
+
+
+// Write the snapshot of the timetable to an anonymous memory file and return its descriptor,
+// the worker processes forked afterwards can map it without any file on disk
+int create_snapshot_memfd(const Timetable& timetable);
+
+
+// Map the timetable from the snapshot file, the snapshot is first created from the dataset
+// files if it does not exist yet
+std::shared_ptr<const Timetable> load_shared_timetable(const std::string& file_path);
+
+#endif // SNAPSHOT_HPP
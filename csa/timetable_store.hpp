@@ -0,0 +1,139 @@
+#ifndef TIMETABLE_STORE_HPP
+#define TIMETABLE_STORE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility> // std::move
+#include <vector>
+
+#include "config.hpp"
+#include "data_structure.hpp"
+#include "numa.hpp"
+#include "snapshot.hpp"
+
+
+// Holds the current snapshot of the timetable in a read-copy-update fashion. Readers acquire
+// a reference-counted pointer to the snapshot at the start of a query and keep using it
+// until the query completes, while a writer builds a new snapshot and publishes it atomically.
+// An old snapshot is released when its last reader drops its reference.
+//
+// After replicate(), the store keeps a copy of each published snapshot in the memory
+// of every NUMA node, and the readers running on a node acquire its local copy.
+//
+// Each publication starts a new generation, which identifies the snapshot on all the nodes,
+// so that the data derived from a snapshot can be shared between the readers of different nodes.
+class TimetableStore {
+public:
+    // Makes a timetable to be published from another one
+    using Transform = std::function<std::shared_ptr<const Timetable>(const std::shared_ptr<const Timetable>&)>;
+
+private:
+    // The snapshot of each node, the first one is the published snapshot itself
+    std::vector<std::shared_ptr<const Timetable>> _replicas;
+    std::vector<std::vector<int>> _node_cpus;
+
+    // Incremented before and after the snapshots of the nodes are replaced, thus odd during a publication,
+    // half of it being the generation of the published snapshots
+    std::atomic<uint64_t> _publish_count {0};
+    std::mutex _publish_mutex;
+
+    // Applied to each reloaded timetable before it is published, see on_reload
+    Transform _reload_hook;
+
+    void publish_locked(std::shared_ptr<const Timetable> timetable) {
+        // The copies are made before any of them is published, so that the nodes
+        // switch to the new snapshot at about the same time
+        std::vector<std::shared_ptr<const Timetable>> replicas {timetable};
+
+        for (std::size_t node = 1; node < _node_cpus.size(); ++node) {
+            replicas.push_back(copy_on_cpus(timetable, _node_cpus[node]));
+        }
+
+        ++_publish_count;
+
+        for (std::size_t node = 0; node < replicas.size(); ++node) {
+            std::atomic_store(&_replicas[node], std::move(replicas[node]));
+        }
+
+        ++_publish_count;
+    }
+
+public:
+    explicit TimetableStore(std::shared_ptr<const Timetable> timetable) : _replicas {std::move(timetable)} {};
+
+    std::shared_ptr<const Timetable> acquire(const std::size_t& node = 0) const {
+        return std::atomic_load(&_replicas[node < _replicas.size() ? node : 0]);
+    }
+
+    // The snapshot of the node together with its generation, retried while a publication is in progress
+    std::shared_ptr<const Timetable> acquire(const std::size_t& node, uint64_t& generation) const {
+        while (true) {
+            auto count = _publish_count.load();
+
+            if (count % 2 == 0) {
+                auto snapshot = acquire(node);
+
+                if (_publish_count.load() == count) {
+                    generation = count / 2;
+                    return snapshot;
+                }
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    void publish(std::shared_ptr<const Timetable> timetable) {
+        std::lock_guard<std::mutex> lock {_publish_mutex};
+        publish_locked(std::move(timetable));
+    }
+
+    // Publish the timetable made by the function from the published one, unless it returns nullptr. The other
+    // publications wait for the function to return, so that the changes of the published timetable made
+    // in the meantime, e.g. by a reload, are never lost.
+    void update(const Transform& make) {
+        std::lock_guard<std::mutex> lock {_publish_mutex};
+
+        auto timetable = make(acquire());
+
+        if (timetable) publish_locked(std::move(timetable));
+    }
+
+    // Set the function making the timetable published by a reload from the reloaded one, which is called
+    // with the same exclusion as the function of update. An empty function publishes the reloaded timetable.
+    void on_reload(Transform hook) {
+        std::lock_guard<std::mutex> lock {_publish_mutex};
+        _reload_hook = std::move(hook);
+    }
+
+    // Start keeping a copy on each of the given nodes, must be called before the readers start
+    void replicate(const std::vector<std::vector<int>>& node_cpus) {
+        _node_cpus = node_cpus;
+        _replicas.resize(std::max<std::size_t>(node_cpus.size(), 1));
+        publish(acquire());
+    }
+
+    std::size_t n_replicas() const { return _replicas.size(); }
+
+    // Load the timetable again in a background thread, the same way as it was first loaded: from the snapshot
+    // file if one is given, otherwise by parsing the dataset files, and publish the new timetable once it is
+    // complete, the queries keep running on the current snapshot in the meantime. The errors which
+    // occurred while loading are rethrown by the get() of the returned future.
+    std::future<void> reload() {
+        return std::async(std::launch::async, [this]() {
+            auto timetable = snapshot_path.empty() ? std::make_shared<const Timetable>() :
+                             load_shared_timetable(snapshot_path);
+
+            std::lock_guard<std::mutex> lock {_publish_mutex};
+            publish_locked(_reload_hook ? _reload_hook(timetable) : std::move(timetable));
+        });
+    }
+};
+
+#endif // TIMETABLE_STORE_HPP
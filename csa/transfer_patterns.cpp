@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unistd.h>
+
+#include "connection_profiles.hpp"
+#include "hash.hpp"
+#include "transfer_patterns.hpp"
+
+
+// The layout of the file of the patterns: a header followed by the prefix nodes and the edges into the target nodes
+// of the sources, the legs are looked up in the routes when the patterns are loaded
+static const char patterns_magic[8] = {'C', 'S', 'A', 'T', 'P', 'A', 'T', 'T'};
+static const uint32_t patterns_version = 2;
+
+struct PatternsHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t hash;
+    uint64_t n_stops;
+    uint64_t n_nodes;
+    uint64_t n_targets;
+};
+
+
+TransferPatterns::TransferPatterns(std::shared_ptr<const Timetable> timetable) : _routes {std::move(timetable)} {
+    auto hash = timetable_hash();
+    std::string file_path = _routes.timetable().path + "transfer_patterns.bin";
+
+    if (load(file_path, hash)) {
+        std::cout << "Loaded " << targets.size() << " transfer patterns from " << file_path << std::endl;
+    } else {
+        compute_patterns();
+        save(file_path, hash);
+    }
+
+    compute_legs();
+}
+
+
+// The DAGs of the sources are built in batches of this number of sources, so that only the trees of a batch
+// are in memory at once, while the profiles to every target are computed again for each batch
+static const std::size_t source_batch_size = 512;
+
+
+// The patterns are extracted from the profiles to each target, the targets being handed out to the threads
+// one at a time. The journey of every pair of the profile of every stop of the batch is unpacked into the stops
+// where it boards and alights its trips, and the distinct patterns from the stop to the target are added to
+// the DAG of the stop as a source: the prefix of a pattern up to its last stop is inserted into the tree of
+// the prefix nodes, and the walk from the end of the prefix to the target becomes an edge into the target node.
+// The DAGs are built under a lock each, and the nodes are numbered in the order they are added. Once all
+// the targets are done, the DAGs of the batch are appended to the patterns.
+void TransferPatterns::compute_patterns() {
+    const auto& timetable = _routes.timetable();
+    const auto n_stops = timetable.stops.size();
+
+    // The children of a node are linked from its first child through their next siblings,
+    // all the children of a node being either walked to or ridden to
+    struct SourcePatterns {
+        std::mutex mutex;
+        std::vector<PatternNode> nodes;
+        std::vector<uint32_t> first_child;
+        std::vector<uint32_t> next_sibling;
+        std::vector<PatternTarget> targets;
+    };
+
+    // A step of a pattern: the stop reached with the walking time to it, or by riding a trip if it is INF
+    struct PatternStep {
+        NodeID stop_id;
+        Time walking_time;
+
+        bool operator<(const PatternStep& other) const {
+            return std::make_pair(stop_id, walking_time) < std::make_pair(other.stop_id, other.walking_time);
+        }
+
+        bool operator==(const PatternStep& other) const {
+            return stop_id == other.stop_id && walking_time == other.walking_time;
+        }
+    };
+
+    const uint32_t no_node = UINT32_MAX;
+
+    // Insert the prefix of the pattern, without its last step to the target
+    auto insert = [&](SourcePatterns& source, const std::vector<PatternStep>& steps) {
+        uint32_t node = 0;
+
+        for (auto step = steps.begin(); step + 1 < steps.end(); ++step) {
+            auto child = source.first_child[node];
+
+            while (child != no_node && source.nodes[child].stop_id != step->stop_id) {
+                child = source.next_sibling[child];
+            }
+
+            if (child == no_node) {
+                child = static_cast<uint32_t>(source.nodes.size());
+
+                // The legs of the nodes ridden to are assigned once all the patterns are known
+                source.nodes.push_back({step->stop_id, node, step->walking_time == INF ? 0 : step->walking_time,
+                                        step->walking_time == INF ? 0 : no_leg});
+                source.first_child.push_back(no_node);
+                source.next_sibling.push_back(source.first_child[node]);
+                source.first_child[node] = child;
+            } else if (step->walking_time != INF) {
+                auto& walking_time = source.nodes[child].walking_time;
+                walking_time = std::min(walking_time, step->walking_time);
+            }
+
+            node = child;
+        }
+
+        return node;
+    };
+
+    node_offsets.assign(1, 0);
+    target_offsets.assign(1, 0);
+    nodes.clear();
+    targets.clear();
+
+    for (std::size_t first_source = 0; first_source < n_stops; first_source += source_batch_size) {
+        const auto n_batch = std::min(source_batch_size, n_stops - first_source);
+        std::vector<SourcePatterns> sources(n_batch);
+
+        for (std::size_t i = 0; i < n_batch; ++i) {
+            sources[i].nodes.push_back({static_cast<NodeID>(first_source + i), 0, 0, no_leg});
+            sources[i].first_child.push_back(no_node);
+            sources[i].next_sibling.push_back(no_node);
+        }
+
+        std::atomic<std::size_t> next_target {0};
+
+        auto worker = [&]() {
+            ConnectionProfiles profiles {&timetable};
+            std::vector<std::vector<PatternStep>> patterns;
+            std::vector<PatternStep> steps;
+            std::vector<std::pair<uint32_t, Time>> ends;
+
+            for (NodeID target_id = next_target++; target_id < n_stops; target_id = next_target++) {
+                profiles.scan(target_id);
+
+                auto add_leg = [&](const Time& walking_time, const ConnectionID& first_id,
+                                   const ConnectionID& last_id) {
+                    steps.push_back({timetable.connections[first_id].departure_stop_id, walking_time});
+                    steps.push_back({timetable.connections[last_id].arrival_stop_id, INF});
+                    return true;
+                };
+
+                for (auto source_id = first_source; source_id < first_source + n_batch; ++source_id) {
+                    patterns.clear();
+
+                    // The pattern only walking to the target
+                    for (const auto& transfer: timetable.transfers(static_cast<NodeID>(source_id))) {
+                        if (transfer.target_id == target_id) patterns.push_back({{target_id, transfer.time}});
+                    }
+
+                    if (source_id != target_id) {
+                        for (const auto& pair: profiles.profile(static_cast<NodeID>(source_id))) {
+                            if (pair.dep == INF) continue;
+
+                            steps.clear();
+                            Time walking_time = timetable.connections[pair.conn_id].departure_time - pair.dep;
+
+                            if (profiles.unpack(pair.conn_id, walking_time, add_leg)) {
+                                steps.push_back({target_id, profiles.walking_time(steps.back().stop_id)});
+                                patterns.push_back(steps);
+                            }
+                        }
+                    }
+
+                    if (patterns.empty()) continue;
+
+                    // Many pairs of a profile share their pattern, which is only inserted once
+                    std::sort(patterns.begin(), patterns.end());
+                    patterns.erase(std::unique(patterns.begin(), patterns.end()), patterns.end());
+
+                    auto& source = sources[source_id - first_source];
+                    std::lock_guard<std::mutex> lock {source.mutex};
+
+                    ends.clear();
+
+                    for (const auto& pattern: patterns) {
+                        ends.emplace_back(insert(source, pattern), pattern.back().walking_time);
+                    }
+
+                    std::sort(ends.begin(), ends.end());
+                    ends.erase(std::unique(ends.begin(), ends.end()), ends.end());
+
+                    for (const auto& end: ends) {
+                        source.targets.push_back({target_id, end.first, end.second});
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for (unsigned i = 0; i < std::max(std::thread::hardware_concurrency(), 1u); ++i) {
+            threads.emplace_back(worker);
+        }
+
+        for (auto& thread: threads) {
+            thread.join();
+        }
+
+        for (auto& source: sources) {
+            std::sort(source.targets.begin(), source.targets.end(),
+                      [](const PatternTarget& a, const PatternTarget& b) {
+                          return std::make_tuple(a.target_id, a.node, a.walking_time) <
+                                 std::make_tuple(b.target_id, b.node, b.walking_time);
+                      });
+
+            nodes.insert(nodes.end(), source.nodes.begin(), source.nodes.end());
+            targets.insert(targets.end(), source.targets.begin(), source.targets.end());
+            node_offsets.push_back(nodes.size());
+            target_offsets.push_back(targets.size());
+
+            // The DAG of the source is no longer needed
+            std::vector<PatternNode>().swap(source.nodes);
+            std::vector<uint32_t>().swap(source.first_child);
+            std::vector<uint32_t>().swap(source.next_sibling);
+            std::vector<PatternTarget>().swap(source.targets);
+        }
+    }
+
+    std::cout << "Computed " << targets.size() << " transfer patterns with " << nodes.size() << " prefix nodes"
+              << std::endl;
+}
+
+
+// The routes of each leg are those serving the stop of the parent and then the stop of the node,
+// the legs being shared by all the sources
+void TransferPatterns::compute_legs() {
+    std::unordered_map<uint64_t, uint32_t> stop_pair_legs;
+
+    leg_offsets.assign(1, 0);
+    leg_routes.clear();
+
+    for (std::size_t source_id = 0; source_id + 1 < node_offsets.size(); ++source_id) {
+        const auto first_node = node_offsets[source_id];
+
+        for (auto i = first_node; i < node_offsets[source_id + 1]; ++i) {
+            auto& node = nodes[i];
+
+            if (i == first_node || node.leg == no_leg) continue;
+
+            const auto& departure_stop_id = nodes[first_node + node.parent].stop_id;
+            uint64_t key = static_cast<uint64_t>(departure_stop_id) << 32 | node.stop_id;
+            auto inserted = stop_pair_legs.emplace(key, static_cast<uint32_t>(leg_offsets.size() - 1));
+
+            if (inserted.second) {
+                for (auto k = _routes.stop_route_offsets[departure_stop_id];
+                     k < _routes.stop_route_offsets[departure_stop_id + 1]; ++k) {
+                    const auto& route_id = _routes.stop_routes[k].first;
+                    const auto& departure_index = _routes.stop_routes[k].second;
+                    const auto& route = _routes.routes[route_id];
+
+                    for (auto j = departure_index + 1; j < route.n_stops; ++j) {
+                        if (_routes.route_stops[route.first_stop + j] == node.stop_id) {
+                            leg_routes.push_back({route_id, departure_index, j});
+                            break;
+                        }
+                    }
+                }
+
+                leg_offsets.push_back(leg_routes.size());
+            }
+
+            node.leg = inserted.first->second;
+        }
+    }
+}
+
+
+// The trips of a route do not overtake each other, thus the first trip departing from the stop
+// is also the first one arriving at the other stop
+Time TransferPatterns::direct_arrival_time(const uint32_t& leg, const Time& departure_time) const {
+    Time arrival_time {INF};
+
+    for (auto k = leg_offsets[leg]; k < leg_offsets[leg + 1]; ++k) {
+        const auto& leg_route = leg_routes[k];
+        const auto& route = _routes.routes[leg_route.route_id];
+        auto trip = _routes.earliest_trip(route, leg_route.departure_index, departure_time, route.n_trips);
+
+        if (trip < route.n_trips) {
+            arrival_time = std::min(arrival_time, _routes.stop_time(route, trip, leg_route.arrival_index).arrival_time);
+        }
+    }
+
+    return arrival_time;
+}
+
+
+uint64_t TransferPatterns::timetable_hash() const {
+    return ::timetable_hash(_routes.timetable()).value();
+}
+
+
+bool TransferPatterns::load(const std::string& file_path, const uint64_t& hash) {
+    std::ifstream in {file_path, std::ios::binary};
+    PatternsHeader header {};
+
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, patterns_magic, sizeof(header.magic)) != 0 ||
+        header.version != patterns_version || header.node_size != sizeof(PatternNode) || header.hash != hash ||
+        header.n_stops != _routes.timetable().stops.size()) {
+        return false;
+    }
+
+    node_offsets.resize(header.n_stops + 1);
+    nodes.resize(header.n_nodes);
+    target_offsets.resize(header.n_stops + 1);
+    targets.resize(header.n_targets);
+
+    in.read(reinterpret_cast<char*>(node_offsets.data()),
+            static_cast<std::streamsize>(node_offsets.size() * sizeof(uint64_t)));
+    in.read(reinterpret_cast<char*>(nodes.data()), static_cast<std::streamsize>(nodes.size() * sizeof(PatternNode)));
+    in.read(reinterpret_cast<char*>(target_offsets.data()),
+            static_cast<std::streamsize>(target_offsets.size() * sizeof(uint64_t)));
+    in.read(reinterpret_cast<char*>(targets.data()),
+            static_cast<std::streamsize>(targets.size() * sizeof(PatternTarget)));
+
+    if (!in || node_offsets.back() != header.n_nodes || target_offsets.back() != header.n_targets) {
+        node_offsets.clear();
+        nodes.clear();
+        target_offsets.clear();
+        targets.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+void TransferPatterns::save(const std::string& file_path, const uint64_t& hash) const {
+    PatternsHeader header {};
+    std::memcpy(header.magic, patterns_magic, sizeof(header.magic));
+    header.version = patterns_version;
+    header.node_size = sizeof(PatternNode);
+    header.hash = hash;
+    header.n_stops = node_offsets.size() - 1;
+    header.n_nodes = nodes.size();
+    header.n_targets = targets.size();
+
+    // Write to a temporary file first, so that other processes never read partial patterns
+    std::string tmp_path = file_path + ".tmp" + std::to_string(getpid());
+    std::ofstream out {tmp_path, std::ios::binary | std::ios::trunc};
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(node_offsets.data()),
+              static_cast<std::streamsize>(node_offsets.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char*>(nodes.data()),
+              static_cast<std::streamsize>(nodes.size() * sizeof(PatternNode)));
+    out.write(reinterpret_cast<const char*>(target_offsets.data()),
+              static_cast<std::streamsize>(target_offsets.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char*>(targets.data()),
+              static_cast<std::streamsize>(targets.size() * sizeof(PatternTarget)));
+    out.close();
+
+    if (!out || std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+        std::cerr << "Error occurred while writing " << file_path << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        exit(1);
+    }
+}
+
+
+TransferPatternQuery::TransferPatternQuery(std::shared_ptr<const TransferPatterns> patterns) :
+        _patterns {std::move(patterns)} {
+    uint64_t max_nodes {0};
+
+    for (std::size_t i = 0; i + 1 < _patterns->node_offsets.size(); ++i) {
+        max_nodes = std::max(max_nodes, _patterns->node_offsets[i + 1] - _patterns->node_offsets[i]);
+    }
+
+    node_time.resize(max_nodes);
+    node_epoch.assign(max_nodes, 0);
+}
+
+
+Time TransferPatternQuery::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time) {
+    const auto& nodes = _patterns->nodes;
+    const auto& first_node = _patterns->node_offsets[source_id];
+
+    if (++epoch == 0) {
+        std::fill(node_epoch.begin(), node_epoch.end(), 0);
+        epoch = 1;
+    }
+
+    node_time[0] = departure_time;
+    node_epoch[0] = epoch;
+
+    auto first = _patterns->targets.begin() + _patterns->target_offsets[source_id];
+    auto last = _patterns->targets.begin() + _patterns->target_offsets[source_id + 1];
+    auto ends = std::equal_range(first, last, PatternTarget {target_id, 0, 0},
+                                 [](const PatternTarget& a, const PatternTarget& b) {
+                                     return a.target_id < b.target_id;
+                                 });
+
+    Time arrival_time {INF};
+
+    // The parents of the target node are evaluated in turn, sharing the evaluation of their common ancestors
+    for (auto end = ends.first; end != ends.second; ++end) {
+        // Climb to the first evaluated ancestor, then evaluate the nodes down to the parent
+        path.clear();
+
+        for (auto node = end->node; node_epoch[node] != epoch; node = nodes[first_node + node].parent) {
+            path.push_back(node);
+        }
+
+        for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+            const auto& node = nodes[first_node + *iter];
+            const auto& parent_time = node_time[node.parent];
+            Time time {INF};
+
+            // The arrival times only increase along a pattern, thus a node reached after the best arrival time
+            // so far cannot improve it
+            if (parent_time < arrival_time) {
+                time = node.leg == TransferPatterns::no_leg ? parent_time + node.walking_time :
+                       _patterns->direct_arrival_time(node.leg, parent_time);
+            }
+
+            node_time[*iter] = time;
+            node_epoch[*iter] = epoch;
+        }
+
+        if (node_time[end->node] < arrival_time) {
+            arrival_time = std::min(arrival_time, node_time[end->node] + end->walking_time);
+        }
+    }
+
+    return arrival_time;
+}
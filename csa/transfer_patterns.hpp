@@ -0,0 +1,113 @@
+#ifndef TRANSFER_PATTERNS_HPP
+#define TRANSFER_PATTERNS_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "raptor.hpp"
+#include "trip_state.hpp"
+
+
+// A prefix node of the patterns of a source. The patterns alternate between walking, possibly zero seconds
+// at the same stop, and riding a trip: the children of the source and of the nodes ridden to are walked to,
+// the children of the nodes walked to are ridden to. The parent of a node is before it in the nodes of the source.
+struct PatternNode {
+    NodeID stop_id;
+    uint32_t parent;
+
+    // The walking time from the stop of the parent, only for the nodes walked to
+    Time walking_time;
+
+    // The direct connections from the stop of the parent, only for the nodes ridden to
+    uint32_t leg;
+};
+
+
+// An edge into the target node of a target, for a pattern of a source ending at the target: the target
+// is reached by walking from the stop of the node, which is the source itself or a node ridden to
+struct PatternTarget {
+    NodeID target_id;
+    uint32_t node;
+    Time walking_time;
+};
+
+
+// The routes going from a stop to another one, with the indices of both stops in the route
+struct RouteLeg {
+    uint32_t route_id;
+    uint32_t departure_index;
+    uint32_t arrival_index;
+};
+
+
+// The transfer patterns of a timetable: the sequences of stops where the optimal journeys between
+// every pair of stops board and alight their trips. The patterns of each source form a DAG, whose prefix nodes
+// are shared by the patterns with the same prefix, and whose target node of each target is shared by all
+// the patterns ending at the target, so that a query only evaluates the ancestors of the target node.
+// The patterns are extracted from the profiles to every stop, and the trips between the stops of the patterns
+// are looked up in the routes.
+class TransferPatterns {
+private:
+    RaptorTimetable _routes;
+
+    void compute_patterns();
+
+    void compute_legs();
+
+    uint64_t timetable_hash() const;
+
+    bool load(const std::string& file_path, const uint64_t& hash);
+
+    void save(const std::string& file_path, const uint64_t& hash) const;
+
+public:
+    static const uint32_t no_leg = UINT32_MAX;
+
+    // The prefix nodes of the patterns of each source, the nodes of the source s are between the offsets
+    // node_offsets[s] and node_offsets[s + 1], the first of them being the source itself
+    std::vector<uint64_t> node_offsets;
+    std::vector<PatternNode> nodes;
+
+    // The edges into the target nodes of each source sorted by target, between the offsets target_offsets[s]
+    // and target_offsets[s + 1]
+    std::vector<uint64_t> target_offsets;
+    std::vector<PatternTarget> targets;
+
+    // The routes of each leg, between the offsets leg_offsets[l] and leg_offsets[l + 1]
+    std::vector<uint64_t> leg_offsets;
+    std::vector<RouteLeg> leg_routes;
+
+    explicit TransferPatterns(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _routes.snapshot(); }
+
+    const RaptorTimetable& routes() const { return _routes; }
+
+    // The earliest arrival time at the stop of the leg when departing from the stop of its parent
+    Time direct_arrival_time(const uint32_t& leg, const Time& departure_time) const;
+};
+
+
+// The earliest arrival query evaluating the patterns from the source to the target, the arrival time
+// at each node being computed once from the arrival time at its parent
+class TransferPatternQuery {
+private:
+    std::shared_ptr<const TransferPatterns> _patterns;
+
+    // The arrival times at the nodes of the source, valid if evaluated during the current epoch
+    std::vector<Time> node_time;
+    std::vector<Epoch> node_epoch;
+    Epoch epoch = 0;
+
+    std::vector<uint32_t> path;
+
+public:
+    explicit TransferPatternQuery(std::shared_ptr<const TransferPatterns> patterns);
+
+    const std::shared_ptr<const TransferPatterns>& patterns() const { return _patterns; }
+
+    Time query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+};
+
+#endif // TRANSFER_PATTERNS_HPP
@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "hash.hpp"
+#include "trip_based.hpp"
+
+
+// The layout of the file of the transfers: a header followed by the offsets of the stop events
+// and the transfers. The hash of the routes and the footpaths they were computed from is recorded,
+// so that the transfers of another timetable are recomputed instead of being used.
+static const char transfers_magic[8] = {'C', 'S', 'A', 'T', 'B', 'T', 'R', '\0'};
+static const uint32_t transfers_version = 1;
+
+struct TransfersHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t element_size;
+    uint64_t hash;
+    uint64_t n_events;
+    uint64_t n_transfers;
+};
+
+
+TripBasedTimetable::TripBasedTimetable(std::shared_ptr<const Timetable> timetable) : _routes {std::move(timetable)} {
+    for (uint32_t route_id = 0; route_id < _routes.routes.size(); ++route_id) {
+        route_first_trip.push_back(static_cast<uint32_t>(trip_route.size()));
+        trip_route.insert(trip_route.end(), _routes.routes[route_id].n_trips, route_id);
+    }
+
+    route_first_trip.push_back(static_cast<uint32_t>(trip_route.size()));
+
+    auto hash = routes_hash();
+    std::string file_path = _routes.timetable().path + "trip_transfers.bin";
+
+    if (load_transfers(file_path, hash)) {
+        std::cout << "Loaded " << transfers.size() << " trip transfers from " << file_path << std::endl;
+        return;
+    }
+
+    compute_transfers();
+    save_transfers(file_path, hash);
+}
+
+
+// The transfers of each trip are computed independently, the trips being handed out to the threads
+// one at a time. Each thread keeps the earliest arrival times at the stops reachable when leaving
+// the current trip, scanning the stops of the trip backward, and a candidate transfer is only kept
+// if it improves one of them.
+void TripBasedTimetable::compute_transfers() {
+    const auto& timetable = _routes.timetable();
+    const auto n_trips = static_cast<uint32_t>(trip_route.size());
+
+    // The kept transfers of each trip, with the index of the stop they leave the trip at
+    std::vector<std::vector<std::pair<uint32_t, TripTransfer>>> trip_transfers(n_trips);
+    std::atomic<uint32_t> next_trip {0};
+    std::atomic<uint64_t> n_candidates {0};
+
+    auto worker = [&]() {
+        std::vector<Time> arrival_time(timetable.max_node_id + 1, INF);
+        std::vector<NodeID> reached_stops;
+        uint64_t n_worker_candidates {0};
+
+        // Arrive at a stop, and walk to its neighbours if the arrival improves, the same way as the connection scan
+        auto improve = [&](const NodeID& stop_id, const Time& time) {
+            if (time >= arrival_time[stop_id]) return false;
+
+            if (arrival_time[stop_id] == INF) reached_stops.push_back(stop_id);
+            arrival_time[stop_id] = time;
+
+            for (const auto& transfer: timetable.transfers(stop_id)) {
+                Time tmp_time = time + transfer.time;
+
+                if (tmp_time < arrival_time[transfer.target_id]) {
+                    if (arrival_time[transfer.target_id] == INF) reached_stops.push_back(transfer.target_id);
+                    arrival_time[transfer.target_id] = tmp_time;
+                }
+            }
+
+            return true;
+        };
+
+        for (uint32_t trip_id = next_trip++; trip_id < n_trips; trip_id = next_trip++) {
+            const auto& route_id = trip_route[trip_id];
+            const auto& route = _routes.routes[route_id];
+            const uint32_t trip = trip_id - route_first_trip[route_id];
+
+            for (uint32_t i = route.n_stops - 1; i > 0; --i) {
+                const auto& stop_id = _routes.route_stops[route.first_stop + i];
+                const auto& time = _routes.stop_time(route, trip, i).arrival_time;
+
+                improve(stop_id, time);
+
+                for (const auto& transfer: timetable.transfers(stop_id)) {
+                    const auto& other_id = transfer.target_id;
+
+                    for (auto k = _routes.stop_route_offsets[other_id]; k < _routes.stop_route_offsets[other_id + 1]; ++k) {
+                        const auto& other_route_id = _routes.stop_routes[k].first;
+                        const auto& j = _routes.stop_routes[k].second;
+                        const auto& other_route = _routes.routes[other_route_id];
+
+                        uint32_t other_trip = _routes.earliest_trip(other_route, j, time + transfer.time,
+                                                                    other_route.n_trips);
+
+                        // Staying on the trip is never worse than changing to a later trip of the same route
+                        if (other_trip == other_route.n_trips ||
+                            (other_route_id == route_id && other_trip >= trip && j >= i)) {
+                            continue;
+                        }
+
+                        ++n_worker_candidates;
+                        bool keep = false;
+
+                        for (uint32_t l = j + 1; l < other_route.n_stops; ++l) {
+                            keep |= improve(_routes.route_stops[other_route.first_stop + l],
+                                            _routes.stop_time(other_route, other_trip, l).arrival_time);
+                        }
+
+                        if (keep) {
+                            trip_transfers[trip_id].push_back({i, {route_first_trip[other_route_id] + other_trip, j}});
+                        }
+                    }
+                }
+            }
+
+            for (const auto& reached_id: reached_stops) {
+                arrival_time[reached_id] = INF;
+            }
+
+            reached_stops.clear();
+        }
+
+        n_candidates += n_worker_candidates;
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 0; i < std::max(std::thread::hardware_concurrency(), 1u); ++i) {
+        threads.emplace_back(worker);
+    }
+
+    for (auto& thread: threads) {
+        thread.join();
+    }
+
+    // The stop events of a trip are consecutive, and follow those of the previous trip
+    transfer_offsets.assign(_routes.stop_times.size() + 1, 0);
+
+    for (uint32_t trip_id = 0; trip_id < n_trips; ++trip_id) {
+        for (const auto& indexed_transfer: trip_transfers[trip_id]) {
+            ++transfer_offsets[stop_event(trip_id, indexed_transfer.first) + 1];
+        }
+    }
+
+    for (std::size_t i = 1; i < transfer_offsets.size(); ++i) {
+        transfer_offsets[i] += transfer_offsets[i - 1];
+    }
+
+    transfers.resize(transfer_offsets.back());
+    std::vector<uint64_t> ends(transfer_offsets.begin(), transfer_offsets.end() - 1);
+
+    for (uint32_t trip_id = 0; trip_id < n_trips; ++trip_id) {
+        for (const auto& indexed_transfer: trip_transfers[trip_id]) {
+            transfers[ends[stop_event(trip_id, indexed_transfer.first)]++] = indexed_transfer.second;
+        }
+    }
+
+    std::cout << "Computed " << transfers.size() << " trip transfers out of " << n_candidates << " candidates"
+              << std::endl;
+}
+
+
+// The hash of the routes and the footpaths
+uint64_t TripBasedTimetable::routes_hash() const {
+    Fnv1aHash hash;
+
+    for (const auto& route: _routes.routes) {
+        hash.add(route.n_stops);
+        hash.add(route.n_trips);
+    }
+
+    for (const auto& stop_id: _routes.route_stops) {
+        hash.add(stop_id);
+    }
+
+    for (const auto& stop_time: _routes.stop_times) {
+        hash.add(stop_time.arrival_time);
+        hash.add(stop_time.departure_time);
+    }
+
+    for (const auto& stop: _routes.timetable().stops) {
+        for (const auto& transfer: _routes.timetable().transfers(stop.id)) {
+            hash.add(transfer.source_id);
+            hash.add(transfer.target_id);
+            hash.add(transfer.time);
+        }
+    }
+
+    return hash.value();
+}
+
+
+bool TripBasedTimetable::load_transfers(const std::string& file_path, const uint64_t& hash) {
+    std::ifstream in {file_path, std::ios::binary};
+    TransfersHeader header {};
+
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, transfers_magic, sizeof(header.magic)) != 0 ||
+        header.version != transfers_version || header.element_size != sizeof(TripTransfer) ||
+        header.hash != hash || header.n_events != _routes.stop_times.size()) {
+        return false;
+    }
+
+    transfer_offsets.resize(header.n_events + 1);
+    transfers.resize(header.n_transfers);
+
+    in.read(reinterpret_cast<char*>(transfer_offsets.data()),
+            static_cast<std::streamsize>(transfer_offsets.size() * sizeof(uint64_t)));
+    in.read(reinterpret_cast<char*>(transfers.data()),
+            static_cast<std::streamsize>(transfers.size() * sizeof(TripTransfer)));
+
+    if (!in || transfer_offsets.back() != header.n_transfers) {
+        transfer_offsets.clear();
+        transfers.clear();
+        return false;
+    }
+
+    return true;
+}
+
+
+void TripBasedTimetable::save_transfers(const std::string& file_path, const uint64_t& hash) const {
+    TransfersHeader header {};
+    std::memcpy(header.magic, transfers_magic, sizeof(header.magic));
+    header.version = transfers_version;
+    header.element_size = sizeof(TripTransfer);
+    header.hash = hash;
+    header.n_events = _routes.stop_times.size();
+    header.n_transfers = transfers.size();
+
+    // Write to a temporary file first, so that other processes never read partial transfers
+    std::string tmp_path = file_path + ".tmp" + std::to_string(getpid());
+    std::ofstream out {tmp_path, std::ios::binary | std::ios::trunc};
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(transfer_offsets.data()),
+              static_cast<std::streamsize>(transfer_offsets.size() * sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char*>(transfers.data()),
+              static_cast<std::streamsize>(transfers.size() * sizeof(TripTransfer)));
+    out.close();
+
+    if (!out || std::rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+        std::cerr << "Error occurred while writing " << file_path << std::endl;
+        std::cerr << "Exiting..." << std::endl;
+        exit(1);
+    }
+}
+
+
+TripBased::TripBased(std::shared_ptr<const TripBasedTimetable> trips) :
+        _trips {std::move(trips)}, _timetable {_trips->snapshot().get()} {
+    first_reached.assign(_trips->trip_route.size(), UINT32_MAX);
+    walking_time_to_target.assign(_timetable->max_node_id + 1, INF);
+}
+
+
+// Reach the trip from the stop, together with the later trips of its route, and queue the part
+// of the trip up to the stop from which it was already reached
+void TripBased::enqueue(const uint32_t& trip_id, const uint32_t& stop_index) {
+    if (stop_index >= first_reached[trip_id]) return;
+
+    const auto& route_id = _trips->trip_route[trip_id];
+    const auto& route = _trips->routes().routes[route_id];
+
+    queue.push_back({trip_id, stop_index, std::min(first_reached[trip_id], route.n_stops - 1)});
+
+    for (auto other_id = trip_id; other_id < _trips->route_first_trip[route_id + 1]; ++other_id) {
+        if (first_reached[other_id] <= stop_index) break;
+
+        first_reached[other_id] = stop_index;
+    }
+}
+
+
+// Board the earliest trip of each route serving the stop
+void TripBased::enqueue_from_stop(const NodeID& stop_id, const Time& time) {
+    const auto& routes = _trips->routes();
+
+    for (auto k = routes.stop_route_offsets[stop_id]; k < routes.stop_route_offsets[stop_id + 1]; ++k) {
+        const auto& route_id = routes.stop_routes[k].first;
+        const auto& stop_index = routes.stop_routes[k].second;
+        const auto& route = routes.routes[route_id];
+
+        uint32_t trip = routes.earliest_trip(route, stop_index, time, route.n_trips);
+
+        if (trip < route.n_trips) {
+            enqueue(_trips->route_first_trip[route_id] + trip, stop_index);
+        }
+    }
+}
+
+
+// Scan the queued segments, the segments queued by their transfers being scanned after them. A segment
+// is cut as soon as it arrives after the target, since neither its stops nor its transfers can improve it.
+void TripBased::scan_segments(Time& arrival_time) {
+    const auto& routes = _trips->routes();
+
+    for (std::size_t k = 0; k < queue.size(); ++k) {
+        const Segment segment = queue[k];
+        const auto& route = _trips->route(segment.trip_id);
+        const auto first_event = _trips->stop_event(segment.trip_id, 0);
+
+        for (uint32_t i = segment.first + 1; i <= segment.last; ++i) {
+            const auto& time = routes.stop_times[first_event + i].arrival_time;
+
+            if (time >= arrival_time) break;
+
+            const auto& walking_time = walking_time_to_target[routes.route_stops[route.first_stop + i]];
+
+            if (walking_time != INF) {
+                arrival_time = std::min(arrival_time, time + walking_time);
+            }
+
+            for (auto l = _trips->transfer_offsets[first_event + i]; l < _trips->transfer_offsets[first_event + i + 1]; ++l) {
+                enqueue(_trips->transfers[l].trip_id, _trips->transfers[l].stop_index);
+            }
+        }
+    }
+
+    queue.clear();
+}
+
+
+// The walking times to the target from the sources of its backward transfers, the target itself
+// being reached without walking, or reset them after the query
+void TripBased::set_target(const NodeID& target_id, const bool& reset) {
+    for (const auto& transfer: _timetable->backward_transfers(target_id)) {
+        auto& walking_time = walking_time_to_target[transfer.source_id];
+        walking_time = reset ? INF : std::min(walking_time, transfer.time);
+    }
+
+    walking_time_to_target[target_id] = reset ? INF : 0;
+}
+
+
+Time TripBased::query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time) {
+    std::fill(first_reached.begin(), first_reached.end(), UINT32_MAX);
+    set_target(target_id, false);
+
+    Time arrival_time {INF};
+
+    for (const auto& transfer: _timetable->transfers(source_id)) {
+        if (transfer.target_id == target_id) {
+            arrival_time = std::min(arrival_time, departure_time + transfer.time);
+        }
+
+        enqueue_from_stop(transfer.target_id, departure_time + transfer.time);
+    }
+
+    scan_segments(arrival_time);
+    set_target(target_id, true);
+
+    return arrival_time;
+}
+
+
+// The trips reached from a later departure stay reached, since the journeys using them depart later,
+// and an earlier departure only adds a pair if it arrives before all the later ones
+ProfilePareto TripBased::profile_query(const NodeID& source_id, const NodeID& target_id) {
+    struct Departure {
+        Time time;
+        uint32_t trip_id;
+        uint32_t stop_index;
+    };
+
+    std::fill(first_reached.begin(), first_reached.end(), UINT32_MAX);
+    set_target(target_id, false);
+
+    const auto& routes = _trips->routes();
+    std::vector<Departure> departures;
+
+    for (const auto& transfer: _timetable->transfers(source_id)) {
+        const auto& stop_id = transfer.target_id;
+
+        for (auto k = routes.stop_route_offsets[stop_id]; k < routes.stop_route_offsets[stop_id + 1]; ++k) {
+            const auto& route_id = routes.stop_routes[k].first;
+            const auto& stop_index = routes.stop_routes[k].second;
+            const auto& route = routes.routes[route_id];
+
+            for (uint32_t trip = 0; trip < route.n_trips; ++trip) {
+                const auto& time = routes.stop_time(route, trip, stop_index).departure_time;
+
+                if (time >= transfer.time) {
+                    departures.push_back({time - transfer.time, _trips->route_first_trip[route_id] + trip, stop_index});
+                }
+            }
+        }
+    }
+
+    std::sort(departures.begin(), departures.end(), [](const Departure& dep1, const Departure& dep2) {
+        return dep1.time > dep2.time;
+    });
+
+    ProfilePareto profile;
+    Time arrival_time {INF};
+
+    for (std::size_t i = 0; i < departures.size();) {
+        const Time departure_time = departures[i].time;
+
+        for (; i < departures.size() && departures[i].time == departure_time; ++i) {
+            enqueue(departures[i].trip_id, departures[i].stop_index);
+        }
+
+        Time previous_time = arrival_time;
+        scan_segments(arrival_time);
+
+        if (arrival_time < previous_time) {
+            profile.emplace(departure_time, arrival_time);
+        }
+    }
+
+    set_target(target_id, true);
+
+    return profile;
+}
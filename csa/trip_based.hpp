@@ -0,0 +1,101 @@
+#ifndef TRIP_BASED_HPP
+#define TRIP_BASED_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "profile_pareto.hpp"
+#include "raptor.hpp"
+
+
+// A transfer from the arrival of a trip at a stop to the departure of another trip at a stop of its route
+struct TripTransfer {
+    uint32_t trip_id;
+    uint32_t stop_index;
+};
+
+
+// The trips of the routes with the transfers between them. The trips are numbered route by route,
+// in the order of the trips in their route. The transfers of the arrival of a trip at a stop,
+// called a stop event, are only kept if they lead to an earlier arrival at some stop than
+// staying on the trip or any other transfer from a later stop of the trip.
+class TripBasedTimetable {
+private:
+    RaptorTimetable _routes;
+
+    void compute_transfers();
+
+    uint64_t routes_hash() const;
+
+    bool load_transfers(const std::string& file_path, const uint64_t& hash);
+
+    void save_transfers(const std::string& file_path, const uint64_t& hash) const;
+
+public:
+    // The first trip of each route, and the route of each trip
+    std::vector<uint32_t> route_first_trip;
+    std::vector<uint32_t> trip_route;
+
+    // The transfers of each stop event, the stop events being numbered as the stop times of the routes,
+    // the transfers of the event e are between the offsets transfer_offsets[e] and transfer_offsets[e + 1]
+    std::vector<uint64_t> transfer_offsets;
+    std::vector<TripTransfer> transfers;
+
+    explicit TripBasedTimetable(std::shared_ptr<const Timetable> timetable);
+
+    const std::shared_ptr<const Timetable>& snapshot() const { return _routes.snapshot(); }
+
+    const RaptorTimetable& routes() const { return _routes; }
+
+    const Route& route(const uint32_t& trip_id) const { return _routes.routes[trip_route[trip_id]]; }
+
+    uint64_t stop_event(const uint32_t& trip_id, const uint32_t& stop_index) const {
+        const auto& trip_route_id = trip_route[trip_id];
+        const auto& trip_route_data = _routes.routes[trip_route_id];
+
+        return trip_route_data.first_stop_time +
+               static_cast<uint64_t>(trip_id - route_first_trip[trip_route_id]) * trip_route_data.n_stops + stop_index;
+    }
+};
+
+
+// The trip-based routing algorithm. The queries scan the segments of the reached trips
+// and follow the precomputed transfers, a trip being reached from its first reached stop only once.
+class TripBased {
+private:
+    struct Segment {
+        uint32_t trip_id;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    std::shared_ptr<const TripBasedTimetable> _trips;
+    const Timetable* _timetable;
+
+    // The index of the first stop from which each trip is reached
+    std::vector<uint32_t> first_reached;
+    std::vector<Time> walking_time_to_target;
+    std::vector<Segment> queue;
+
+    void enqueue(const uint32_t& trip_id, const uint32_t& stop_index);
+
+    void enqueue_from_stop(const NodeID& stop_id, const Time& time);
+
+    void scan_segments(Time& arrival_time);
+
+    void set_target(const NodeID& target_id, const bool& reset);
+
+public:
+    explicit TripBased(std::shared_ptr<const TripBasedTimetable> trips);
+
+    const std::shared_ptr<const TripBasedTimetable>& trips() const { return _trips; }
+
+    Time query(const NodeID& source_id, const NodeID& target_id, const Time& departure_time);
+
+    // The pairs of departure time at the source and arrival time at the target of the Pareto-optimal journeys,
+    // computed by running the query for each departure from the source, the latest one first
+    ProfilePareto profile_query(const NodeID& source_id, const NodeID& target_id);
+};
+
+#endif // TRIP_BASED_HPP
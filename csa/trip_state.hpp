@@ -0,0 +1,108 @@
+#ifndef TRIP_STATE_HPP
+#define TRIP_STATE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "data_structure.hpp"
+
+
+// The per-query states of the trips are reset by advancing an epoch instead of clearing
+// the containers. An entry is only valid if it was written during the current epoch,
+// thus starting a new query does not touch the memory of the trips at all.
+using Epoch = uint32_t;
+
+
+// The reached flags of the trips, packed 32 per word. Each word carries the epoch
+// in which it was last written, so that the flags and their validity are loaded together.
+class TripReachedBits {
+private:
+    struct Word {
+        Epoch epoch;
+        uint32_t bits;
+    };
+
+    std::vector<Word> _words;
+    Epoch _epoch = 0;
+
+public:
+    void resize(const std::size_t& n_trips) {
+        _words.resize((n_trips + 31) / 32, {0, 0});
+    }
+
+    // Invalidate all the flags
+    void reset() {
+        if (++_epoch == 0) {
+            // The epoch wraps around, the stale epochs could become valid again
+            std::fill(_words.begin(), _words.end(), Word {0, 0});
+            _epoch = 1;
+        }
+    }
+
+    inline bool is_reached(const TripID& trip_id) const {
+        const Word& word = _words[trip_id >> 5];
+        return word.epoch == _epoch && (word.bits >> (trip_id & 31)) & 1;
+    }
+
+    inline void mark_reached(const TripID& trip_id) {
+        Word& word = _words[trip_id >> 5];
+
+        if (word.epoch != _epoch) {
+            word = {_epoch, 0};
+        }
+
+        word.bits |= uint32_t {1} << (trip_id & 31);
+    }
+};
+
+
+// The states of the trips in the profile query, where the reached flag is stored next to
+// the earliest arrival time at the target when staying on the trip, since the backward scan
+// reads both of them for every connection. A trip is reached iff its record was written
+// during the current epoch.
+class TripRecords {
+private:
+    struct Record {
+        Epoch epoch;
+        Time earliest_time;
+    };
+
+    std::vector<Record> _records;
+    Epoch _epoch = 0;
+
+public:
+    void resize(const std::size_t& n_trips) {
+        _records.resize(n_trips, {0, INF});
+    }
+
+    void reset() {
+        if (++_epoch == 0) {
+            std::fill(_records.begin(), _records.end(), Record {0, INF});
+            _epoch = 1;
+        }
+    }
+
+    inline bool is_reached(const TripID& trip_id) const {
+        return _records[trip_id].epoch == _epoch;
+    }
+
+    inline void mark_reached(const TripID& trip_id) {
+        Record& record = _records[trip_id];
+
+        if (record.epoch != _epoch) {
+            record = {_epoch, INF};
+        }
+    }
+
+    // Only meaningful for a reached trip
+    inline const Time& earliest_time(const TripID& trip_id) const {
+        return _records[trip_id].earliest_time;
+    }
+
+    inline void set_earliest_time(const TripID& trip_id, const Time& time) {
+        _records[trip_id].earliest_time = time;
+    }
+};
+
+#endif // TRIP_STATE_HPP